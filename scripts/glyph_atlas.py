@@ -0,0 +1,123 @@
+# PlatformIO pre-build script, generates glyph_atlas.h for the firmware.
+#
+# The atlas holds only the characters that can end up on screen: those in the
+# string literals of the sources below, plus the ones that only appear through
+# formatting. Their bitmaps are taken from the GLCD font of the TFT_eSPI the
+# environment was built with, so TFT_eSPI itself doesn't need any font
+# compiled in. The header is only rewritten when its contents change.
+
+Import("env")
+
+import os
+import re
+
+# Sources whose strings are drawn, as titles, texts or menu options
+TEXT_SOURCES = ["menu.cpp", "game.cpp", "network.cpp", "graphics.cpp"]
+# Scores, MAC addresses, and '?', drawn in place of anything missing
+EXTRA_CHARACTERS = "0123456789abcdef:?"
+FONT_PATH = os.path.join("TFT_eSPI", "Fonts", "glcdfont.c")
+# Cell of the GLCD font: five columns and a blank one, eight rows
+FONT_COLUMNS = 5
+FONT_ADVANCE = 6
+FONT_HEIGHT = 8
+FIRST_CHARACTER = 32
+LAST_CHARACTER = 126
+
+LITERAL = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+ESCAPES = {"n": "\n", "t": "\t", "\\": "\\", '"': '"', "'": "'"}
+
+
+def used_characters(src_dir):
+    characters = set(EXTRA_CHARACTERS)
+    for name in TEXT_SOURCES:
+        with open(os.path.join(src_dir, name)) as source:
+            for line in source:
+                if line.lstrip().startswith("#include"):
+                    continue
+                for literal in LITERAL.findall(line):
+                    text = re.sub(r"\\(.)", lambda m: ESCAPES.get(m.group(1), ""), literal)
+                    characters.update(text)
+    return sorted(c for c in characters if FIRST_CHARACTER <= ord(c) <= LAST_CHARACTER)
+
+
+def find_font():
+    libdeps = os.path.join(env.subst("$PROJECT_LIBDEPS_DIR"), env.subst("$PIOENV"))
+    path = os.path.join(libdeps, FONT_PATH)
+    if not os.path.isfile(path):
+        print("glyph_atlas: %s not found, is TFT_eSPI installed?" % path)
+        env.Exit(1)
+    return path
+
+
+def read_font(path):
+    with open(path) as source:
+        text = source.read()
+    # Only the array, the comments above it may hold hex numbers too
+    body = text[text.index("{", text.index("font[")):text.index("};")]
+    data = [int(value, 16) for value in re.findall(r"0x([0-9A-Fa-f]{2})", body)]
+    if len(data) < (LAST_CHARACTER + 1) * FONT_COLUMNS:
+        print("glyph_atlas: %s is shorter than expected" % path)
+        env.Exit(1)
+    return data
+
+
+def generate(characters, font):
+    index = {c: i for i, c in enumerate(characters)}
+    missing = index["?"]
+    lines = [
+        "// Generated by scripts/glyph_atlas.py from the TFT_eSPI GLCD font, do not edit",
+        "#pragma once",
+        "",
+        "#include <cstdint>",
+        "",
+        "#define ATLAS_FIRST %d" % FIRST_CHARACTER,
+        "#define ATLAS_RANGE %d" % (LAST_CHARACTER - FIRST_CHARACTER + 1),
+        "#define ATLAS_GLYPHS %d" % len(characters),
+        "#define ATLAS_COLUMNS %d" % FONT_COLUMNS,
+        "#define ATLAS_HEIGHT %d" % FONT_HEIGHT,
+        "#define ATLAS_MAX_ADVANCE %d" % FONT_ADVANCE,
+        "#define ATLAS_MISSING %d" % missing,
+        "",
+        "// Atlas glyph of every printable character, ATLAS_MISSING if it isn't used",
+        "static const uint8_t atlasIndex[ATLAS_RANGE] = {",
+    ]
+    codes = range(FIRST_CHARACTER, LAST_CHARACTER + 1)
+    for start in range(0, len(codes), 16):
+        row = codes[start:start + 16]
+        lines.append("  " + " ".join("%d," % index.get(chr(code), missing) for code in row))
+    lines += [
+        "};",
+        "",
+        "static const uint8_t atlasAdvances[ATLAS_GLYPHS] = {",
+    ]
+    for start in range(0, len(characters), 16):
+        lines.append("  " + " ".join("%d," % FONT_ADVANCE for _ in characters[start:start + 16]))
+    lines += [
+        "};",
+        "",
+        "// One byte per column, the top row in bit 0",
+        "static const uint8_t atlasColumns[ATLAS_GLYPHS][ATLAS_COLUMNS] = {",
+    ]
+    for c in characters:
+        at = ord(c) * FONT_COLUMNS
+        columns = ", ".join("0x%02X" % value for value in font[at:at + FONT_COLUMNS])
+        lines.append("  {%s}, // %s" % (columns, repr(c)))
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def write_if_changed(path, contents):
+    if os.path.isfile(path):
+        with open(path) as existing:
+            if existing.read() == contents:
+                return
+    with open(path, "w") as header:
+        header.write(contents)
+
+
+characters = used_characters(env.subst("$PROJECT_SRC_DIR"))
+atlas_dir = os.path.join(env.subst("$BUILD_DIR"), "atlas")
+os.makedirs(atlas_dir, exist_ok=True)
+write_if_changed(os.path.join(atlas_dir, "glyph_atlas.h"), generate(characters, read_font(find_font())))
+env.Append(CPPPATH=[atlas_dir])
+print("glyph_atlas: %d glyphs" % len(characters))
@@ -1,32 +1,27 @@
 #include "player.h"
 
+#define TICK_US (INTERVAL * 1000)
+
 Player::Player(Side side):
     side(side),
-    score(0),
-    paddle(nullptr),
-    speed(3),
-    moving(0),
-    lButton(nullptr),
-    rButton(nullptr) {}
-
-void Player::tick() {
-  if (this->moving) {
-    Paddle* p = this->getPaddle();
-    p->setPos(p->getPos() + moving);
-  }
-}
-
-void Player::tick(RemoteTick* remoteTick) {
-    Paddle* p = this->getPaddle();
-    p->setPos(WINDOW_WIDTH - remoteTick->playerPos);
-}
-
-void Player::render(bool force) {
-  paddle->render(force);
-}
-
-Paddle* Player::getPaddle() {
-  return this->paddle;
+    direction(0),
+    remote(false),
+    held(0),
+    countedTo(0),
+    carry(0),
+    tracer(nullptr),
+    trace(0) {}
+
+int Player::getInput() {
+  count(micros());
+  if (held > TICK_US) held = TICK_US;
+  if (held < -TICK_US) held = -TICK_US;
+  fixed_t move = toFixed(Board::paddleSpeed) * held / TICK_US + carry;
+  // Truncates towards zero, so the carry keeps the sign of the move
+  int pixels = move / FIXED_ONE;
+  carry = move - toFixed(pixels);
+  held = 0;
+  return pixels;
 }
 
 Side Player::getSide() {
@@ -34,38 +29,11 @@ Side Player::getSide() {
 }
 
 int Player::getMovingDirection() {
-  return this->moving;
-}
-
-int Player::getScore() {
-  return this->score;
-}
-
-void Player::setPaddle(Paddle *paddle) {
-  this->paddle = paddle;
-}
-
-void Player::setScore(int score) {
-  this->score = score;
+  return direction;
 }
 
-void Player::setControls(OneButton* lButton, OneButton* rButton) {
-  this->lButton = lButton;
-  this->rButton = rButton;
-
-  this->lButton->setLongPressIntervalMs(0);
-  this->rButton->setLongPressIntervalMs(0);
-
-  this->lButton->setClickMs(0);
-  this->rButton->setClickMs(0);
-
-  this->lButton->attachPress(Player::handleMoveLeftStart, this);
-  this->lButton->attachClick(Player::handleMoveLeftStop, this);
-  this->lButton->attachLongPressStop(Player::handleMoveLeftStop, this);
-
-  this->rButton->attachPress(Player::handleMoveRightStart, this);
-  this->rButton->attachClick(Player::handleMoveRightStop, this);
-  this->rButton->attachLongPressStop(Player::handleMoveRightStop, this);
+void Player::setControls(Controls* controls) {
+  controls->setEdgeListener(Player::handleEdge, this);
 }
 
 void Player::setRemote(bool remote) {
@@ -73,56 +41,47 @@ void Player::setRemote(bool remote) {
 }
 
 int Player::getSpeed() {
-  return this->speed;
+  return Board::paddleSpeed;
 }
 
 bool Player::isRemote() {
   return this->remote;
 }
 
-void Player::handleMoveLeftStart(void* context) {
-  Serial.println("Handle move left");
-  Player* player = static_cast<Player*>(context);
-  player->startMoving(-1);
+void Player::setTracer(LatencyTracer* tracer) {
+  this->tracer = tracer;
 }
 
-void Player::handleMoveRightStart(void* context) {
-  Serial.println("Handle move right");
-  Player* player = static_cast<Player*>(context);
-  player->startMoving(1);
+uint16_t Player::getTrace() {
+  return trace;
 }
 
-void Player::handleMoveLeftStop(void* context) {
-  Serial.println("Handle stop left");
-  Player* player = static_cast<Player*>(context);
-  if (player->getMovingDirection() < 0) player->stopMoving();
+void Player::clearTrace() {
+  trace = 0;
 }
 
-void Player::handleMoveRightStop(void* context) {
-  Serial.println("Handle stop right");
-  Player* player = static_cast<Player*>(context);
-  if (player->getMovingDirection() > 0) player->stopMoving();
+void Player::count(uint32_t time) {
+  // An edge drained after the tick it happened in has already been counted
+  if ((int32_t) (time - countedTo) < 0) time = countedTo;
+  held += direction * (int32_t) (time - countedTo);
+  countedTo = time;
 }
 
-void Player::startMoving(int direction) {
-  this->moving = speed * direction;
+void Player::handleEdge(void* context, const ButtonEvent& event) {
+  Player* player = static_cast<Player*>(context);
+  int pressedDirection = event.button == LEFT_BUTTON ? -1 : 1;
+  player->count(event.time);
+  // The last button pressed wins, releasing the other one doesn't stop it
+  if (event.pressed) {
+    player->direction = pressedDirection;
+    if (player->tracer) player->trace = player->tracer->begin(event.time, micros());
+  } else if (player->direction == pressedDirection) {
+    player->direction = 0;
+  }
 }
 
 void Player::stopMoving() {
-  this->moving = 0;
-}
-
-void Player::centralize() {
-  moving = 0;
-  paddle->centralize();
+  direction = 0;
+  held = 0;
+  carry = 0;
 }
-
-int Player::bounce(Ball* ball) {
-  return paddle->bounce(ball);
-}
-
-void Player::reset() {
-  stopMoving();
-  paddle->reset();
-  score = 0;
-}
\ No newline at end of file
@@ -1,45 +1,44 @@
 #pragma once
 
-#include <OneButton.h>
-#include "ball.h"
+#include "controls.h"
 #include "game.h"
+#include "latency.h"
 #include "macros.h"
-#include "paddle.h"
 
 enum class Side;
-class Ball;
-class Paddle;
 
+// Turns button presses into paddle moves for the simulation. Presses are
+// timed to the microsecond, so a tick only moves the paddle for the part of
+// it the button was actually held, and what's left of a pixel carries over
+// to the next tick.
 class Player {
 public:
   Player(Side side);
-  void tick();
-  void tick(RemoteTick* remoteTick);
-  void render(bool force = false);
+  // The move for the tick that ends now
+  int getInput();
   Side getSide();
-  Paddle* getPaddle();
   int getMovingDirection();
-  int getScore();
   int getSpeed();
   bool isRemote();
-  void setScore(int score);
-  void setPaddle(Paddle* paddle);
-  void setControls(OneButton* lButton, OneButton* rButton);
+  void setControls(Controls* controls);
   void setRemote(bool remote);
-  static void handleMoveLeftStart(void* context);
-  static void handleMoveRightStart(void* context);
-  static void handleMoveLeftStop(void* context);
-  static void handleMoveRightStop(void* context);
-  int bounce(Ball* ball);
-  void startMoving(int direction);
+  void setTracer(LatencyTracer* tracer);
+  // The latest press whose move hasn't reached the paddle yet, 0 if none
+  uint16_t getTrace();
+  void clearTrace();
+  static void handleEdge(void* context, const ButtonEvent& event);
   void stopMoving();
-  void centralize();
-  void reset();
 private:
   const Side side;
-  int score, speed, moving;
+  int direction;
   bool remote;
-  OneButton* lButton;
-  OneButton* rButton;
-  Paddle* paddle;
-};
\ No newline at end of file
+  // Signed microseconds held in the current tick, and when it was counted to
+  int32_t held;
+  uint32_t countedTo;
+  // Q8.8 fraction of a pixel left over from previous ticks
+  fixed_t carry;
+  LatencyTracer* tracer;
+  uint16_t trace;
+
+  void count(uint32_t time);
+};
@@ -1,33 +1,16 @@
 #pragma once
-#include "game.h"
-
-enum class Side;
+#include "draw_list.h"
+#include "simulation.h"
 
+// Draws the ball of a GameState through the draw list, the physics live in
+// simulation.h
 class Ball {
 public:
-  Ball(int size);
-  int tick();
-  void render();
+  Ball(const BallState* state, int sprite);
+  void render(DrawList* drawList);
   int getX();
   int getY();
-  int getSize();
-  int getSpeedX();
-  int getSpeedY();
-  int getMaxXSpeed();
-  Side getDirection();
-  void setX(int x);
-  void setY(int y);
-  void setSpeedX(int xSpeed);
-  void setSpeedY(int ySpeed);
-  void setPosition(int x, int y);
-  bool isInCenter(int threshold);
-  void bounce(int angle);
-  void recenter();
-  void reset();
 private:
-  int x, y;
-  int prevX, prevY;
-  int size;
-  int maxXSpeed;
-  int xSpeed, ySpeed;
-};
\ No newline at end of file
+  const BallState* state;
+  int sprite;
+};
@@ -0,0 +1,256 @@
+#include "batch.h"
+
+// All ones when the condition holds, zero otherwise
+static inline int32_t mask(bool condition) {
+  return -(int32_t) condition;
+}
+
+// a where the mask is set, b elsewhere
+static inline int32_t blend(int32_t mask, int32_t a, int32_t b) {
+  return (a & mask) | (b & ~mask);
+}
+
+static inline int32_t absolute(int32_t value) {
+  int32_t sign = value >> 31;
+  return (value ^ sign) - sign;
+}
+
+static inline int32_t clampPaddle(int32_t pos) {
+  pos = blend(mask(pos - Board::paddleHalfWidth < 0), Board::paddleHalfWidth, pos);
+  return blend(mask(pos + Board::paddleHalfWidth > Board::width), Board::width - Board::paddleHalfWidth - 1, pos);
+}
+
+MatchBatch::MatchBatch(int count, uint32_t seed):
+    count(count),
+    tick(new uint32_t[count]),
+    rng(new uint32_t[count]),
+    ballX(new int32_t[count]),
+    ballY(new int32_t[count]),
+    speedX(new int32_t[count]),
+    speedY(new int32_t[count]),
+    upPos(new int32_t[count]),
+    downPos(new int32_t[count]),
+    upScore(new int32_t[count]),
+    downScore(new int32_t[count]),
+    scored(new int32_t[count]),
+    heading(new int32_t[count]),
+    target(new int32_t[count]),
+    sweeping(new int32_t[count]),
+    timeLeft(new int32_t[count]) {
+  for (int i = 0; i < count; i++) {
+    GameState state;
+    initState(state, seed + i);
+    resetMatch(state);
+    setState(i, state);
+  }
+}
+
+MatchBatch::~MatchBatch() {
+  delete[] tick;
+  delete[] rng;
+  delete[] ballX;
+  delete[] ballY;
+  delete[] speedX;
+  delete[] speedY;
+  delete[] upPos;
+  delete[] downPos;
+  delete[] upScore;
+  delete[] downScore;
+  delete[] scored;
+  delete[] heading;
+  delete[] target;
+  delete[] sweeping;
+  delete[] timeLeft;
+}
+
+int MatchBatch::getCount() {
+  return count;
+}
+
+GameState MatchBatch::getState(int index) {
+  GameState state;
+  state.tick = tick[index];
+  state.rng = rng[index];
+  state.ball = {ballX[index], ballY[index], speedX[index], speedY[index]};
+  state.paddles[UP_PADDLE].pos = upPos[index];
+  state.paddles[DOWN_PADDLE].pos = downPos[index];
+  state.scores[UP_PADDLE] = upScore[index];
+  state.scores[DOWN_PADDLE] = downScore[index];
+  return state;
+}
+
+void MatchBatch::setState(int index, const GameState& state) {
+  tick[index] = state.tick;
+  rng[index] = state.rng;
+  ballX[index] = state.ball.x;
+  ballY[index] = state.ball.y;
+  speedX[index] = state.ball.xSpeed;
+  speedY[index] = state.ball.ySpeed;
+  upPos[index] = state.paddles[UP_PADDLE].pos;
+  downPos[index] = state.paddles[DOWN_PADDLE].pos;
+  upScore[index] = state.scores[UP_PADDLE];
+  downScore[index] = state.scores[DOWN_PADDLE];
+}
+
+void MatchBatch::step(const int32_t* upMoves, const int32_t* downMoves) {
+  movePaddles(upMoves, downMoves);
+  sweep();
+  serve();
+}
+
+void MatchBatch::track(int32_t* upMoves, int32_t* downMoves) {
+  // Members are copied to locals, otherwise every store through the output
+  // arrays could alias them and they'd be reloaded on each lane
+  const int lanes = count;
+  const int32_t* x = ballX;
+  const int32_t* up = upPos;
+  const int32_t* down = downPos;
+  for (int i = 0; i < lanes; i++) {
+    int32_t upMove = (x[i] >> FIXED_SHIFT) - up[i];
+    int32_t downMove = (x[i] >> FIXED_SHIFT) - down[i];
+    upMoves[i] = blend(mask(upMove > Board::paddleSpeed), Board::paddleSpeed, blend(mask(upMove < -Board::paddleSpeed), -Board::paddleSpeed, upMove));
+    downMoves[i] = blend(mask(downMove > Board::paddleSpeed), Board::paddleSpeed, blend(mask(downMove < -Board::paddleSpeed), -Board::paddleSpeed, downMove));
+  }
+}
+
+void MatchBatch::movePaddles(const int32_t* upMoves, const int32_t* downMoves) {
+  // step() leaves a paddle alone when it doesn't move, which is the same as
+  // clamping its current position since that is already in range
+  const int lanes = count;
+  int32_t* up = upPos;
+  int32_t* down = downPos;
+  for (int i = 0; i < lanes; i++) {
+    up[i] = clampPaddle(up[i] + upMoves[i]);
+    down[i] = clampPaddle(down[i] + downMoves[i]);
+  }
+}
+
+// Integer division through floats, which vectorizes where integer division
+// doesn't. Dividends are Q8.8 distances shifted by FIXED_SHIFT, so they are
+// exact in a float, and divisors are speeds below 2^11. Whenever the quotient
+// is small enough to be used as a time of impact, it can't land closer to an
+// integer than the float error, so truncating gives exactly what integer
+// division would. Larger quotients only need to stay larger than a tick.
+static_assert(Board::ballMaxSpeed < 1 << 11 && Board::ballMaxXSpeed < 1 << 11, "Speeds too fast for divide()");
+static inline int32_t divide(int32_t a, int32_t b) {
+  return (int32_t) ((float) a / (float) b);
+}
+
+// Same as the sweep in step(). The first impact pass runs over every lane at
+// once, and as most balls hit nothing during a tick, only the few lanes that
+// did go through the remaining passes one at a time.
+void MatchBatch::sweep() {
+  const int32_t half = Board::ballHalfSize;
+  const int32_t upFace = toFixed(Board::paddleHeight);
+  const int32_t downFace = toFixed(Board::height - Board::paddleHeight);
+  // Locals, so stores can't alias the members
+  const int lanes = count;
+  int32_t* x = ballX;
+  int32_t* y = ballY;
+  int32_t* xSpeed = speedX;
+  int32_t* ySpeed = speedY;
+  int32_t* lost = scored;
+  uint32_t* ticks = tick;
+  const int32_t* up = upPos;
+  const int32_t* downward = downPos;
+  int32_t* down = heading;
+  int32_t* pos = target;
+  int32_t* active = sweeping;
+  int32_t* remaining = timeLeft;
+
+  // Each lane only touches its own index
+  #pragma GCC ivdep
+  for (int i = 0; i < lanes; i++) {
+    int32_t pixelY = y[i] >> FIXED_SHIFT;
+    lost[i] = blend(mask(pixelY - Board::ballSize >= Board::height), -1, blend(mask(pixelY + Board::ballSize <= 0), 1, 0));
+    ticks[i]++;
+    // The paddle the ball heads to at the start of the tick
+    down[i] = mask(ySpeed[i] > 0);
+    pos[i] = blend(down[i], downward[i], up[i]);
+    active[i] = mask(lost[i] == 0);
+    remaining[i] = blend(active[i], FIXED_ONE, 0);
+  }
+
+  auto pass = [=](int i) {
+    active[i] &= mask(remaining[i] > 0);
+    int32_t time = remaining[i];
+
+    int32_t xMagnitude = absolute(xSpeed[i]);
+    int32_t wallDistance = blend(mask(xSpeed[i] < 0), x[i] - half, toFixed(Board::width) - (x[i] + half));
+    int32_t wallTime = blend(mask(wallDistance <= 0), 0, divide(wallDistance * FIXED_ONE, xMagnitude | mask(xSpeed[i] == 0)));
+    int32_t wall = mask(xSpeed[i] != 0) & mask(wallTime <= time);
+    time = blend(wall, wallTime, time);
+
+    int32_t yMagnitude = absolute(ySpeed[i]);
+    int32_t towards = mask(ySpeed[i] != 0) & ~(down[i] ^ mask(ySpeed[i] > 0));
+    int32_t faceDistance = blend(mask(ySpeed[i] > 0), downFace - (y[i] + half), (y[i] - half) - upFace);
+    int32_t faceTime = divide(faceDistance * FIXED_ONE, yMagnitude | mask(ySpeed[i] == 0));
+    // Out of range times are zeroed, so the product can't overflow
+    int32_t reachable = mask(faceDistance >= 0) & mask(faceTime <= time);
+    int32_t hitX = x[i] + xSpeed[i] * (faceTime & reachable) / FIXED_ONE;
+    int32_t left = toFixed(pos[i] - Board::paddleHalfWidth);
+    int32_t right = toFixed(pos[i] + Board::paddleHalfWidth);
+    int32_t paddle = towards & reachable & mask(hitX + half >= left) & mask(hitX - half <= right);
+    time = blend(paddle, faceTime, time);
+    wall &= ~paddle;
+
+    time &= active[i];
+    x[i] += xSpeed[i] * time / FIXED_ONE;
+    y[i] += ySpeed[i] * time / FIXED_ONE;
+    remaining[i] -= time;
+    wall &= active[i];
+    paddle &= active[i];
+    // A pass without an impact ends the sweep
+    active[i] &= wall | paddle;
+
+    int32_t bounceX = ((x[i] >> FIXED_SHIFT) - pos[i]) * Board::ballMaxXSpeed / Board::paddleHalfWidth;
+    bounceX = blend(mask(bounceX < -Board::ballMaxXSpeed), -Board::ballMaxXSpeed, bounceX);
+    bounceX = blend(mask(bounceX > Board::ballMaxXSpeed), Board::ballMaxXSpeed, bounceX);
+    int32_t speed = yMagnitude + BALL_ACCELERATION;
+    speed = blend(mask(speed > Board::ballMaxSpeed), Board::ballMaxSpeed, speed);
+    xSpeed[i] = blend(wall, -xSpeed[i], xSpeed[i]);
+    xSpeed[i] = blend(paddle, bounceX, xSpeed[i]);
+    ySpeed[i] = blend(paddle, blend(mask(ySpeed[i] > 0), -speed, speed), ySpeed[i]);
+  };
+
+  #pragma GCC ivdep
+  for (int i = 0; i < lanes; i++) pass(i);
+  for (int i = 0; i < lanes; i++) {
+    for (int impact = 1; impact < MAX_IMPACTS && active[i]; impact++) pass(i);
+  }
+}
+
+// scorePoint() for every lane that lost the ball this tick
+void MatchBatch::serve() {
+  const int lanes = count;
+  const int32_t* lost = scored;
+  int32_t* upPoints = upScore;
+  int32_t* downPoints = downScore;
+  for (int i = 0; i < lanes; i++) {
+    upPoints[i] += lost[i] < 0;
+    downPoints[i] += lost[i] > 0;
+  }
+
+  // Serving draws from the PRNG, which doesn't vectorize, and only a few
+  // lanes score on any tick
+  for (int i = 0; i < lanes; i++) {
+    if (!lost[i]) continue;
+    // Two xorshift32 draws, as recenterBall() makes them
+    uint32_t state = rng[i];
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    uint32_t first = state;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    rng[i] = state;
+
+    ballX[i] = toFixed(WINDOW_WIDTH / 2);
+    ballY[i] = toFixed(WINDOW_HEIGHT / 2);
+    speedX[i] = -Board::ballMaxXSpeed + (int32_t) (first % (uint32_t) (2 * Board::ballMaxXSpeed + 1));
+    speedY[i] = state % 2 ? Board::ballSpeed : -Board::ballSpeed;
+    upPos[i] = WINDOW_WIDTH / 2;
+    downPos[i] = WINDOW_WIDTH / 2;
+  }
+}
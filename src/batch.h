@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include "simulation.h"
+
+// Steps many independent matches at once with the same rules as step() and
+// scorePoint(), for offline tuning and balance runs. Each field of GameState
+// is kept in its own array, and the paddle moves, the first impact pass of
+// the sweep and scoring run every lane through the same instructions, with
+// bounces selected through masks instead of branches, so those loops
+// vectorize. The rare lanes that hit something or score are finished one at
+// a time. A lane stepped here ends up bit-identical to the same GameState
+// stepped with step().
+class MatchBatch {
+public:
+  MatchBatch(int count, uint32_t seed);
+  MatchBatch(const MatchBatch&) = delete;
+  ~MatchBatch();
+  int getCount();
+  // Moves of every lane's paddles, then one tick. Points are scored and the
+  // ball served again right away.
+  void step(const int32_t* upMoves, const int32_t* downMoves);
+  // Moves each paddle towards the ball at paddle speed, a cheap opponent for
+  // bulk runs
+  void track(int32_t* upMoves, int32_t* downMoves);
+  GameState getState(int index);
+  void setState(int index, const GameState& state);
+private:
+  int count;
+  uint32_t* tick;
+  uint32_t* rng;
+  int32_t* ballX;
+  int32_t* ballY;
+  int32_t* speedX;
+  int32_t* speedY;
+  int32_t* upPos;
+  int32_t* downPos;
+  int32_t* upScore;
+  int32_t* downScore;
+  // Scratch, -1/1 for lanes that scored this tick
+  int32_t* scored;
+  // Sweep scratch: paddle the ball heads to, its position, whether the lane
+  // is still sweeping and the time left of the tick
+  int32_t* heading;
+  int32_t* target;
+  int32_t* sweeping;
+  int32_t* timeLeft;
+
+  void movePaddles(const int32_t* upMoves, const int32_t* downMoves);
+  void sweep();
+  void serve();
+};
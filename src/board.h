@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include "fixed.h"
+
+// What changes from one board to the next: the panel, how it's turned and
+// the sizes and speeds that suit it. A profile is nothing but constants, so
+// the simulation and the rendering are compiled for one board at a time and
+// every size, half size and center folds into the code. A new board only
+// needs a profile here and BOARD_PROFILE set in its environment.
+//
+// Both boards of a multiplayer match mirror each other's field, so they have
+// to be built with the same profile.
+
+// The 1.14" ST7789 of the original boards, in portrait
+struct St7789Portrait135x240 {
+  static constexpr int width = 135;
+  static constexpr int height = 240;
+  static constexpr uint8_t rotation = 0;
+  static constexpr int paddleWidth = 30;
+  static constexpr int paddleHeight = 4;
+  // Pixels per tick
+  static constexpr int paddleSpeed = 3;
+  static constexpr int ballSize = 8;
+  // Q8.8 pixels per tick
+  static constexpr fixed_t ballSpeed = toFixed(2);
+  static constexpr fixed_t ballMaxSpeed = toFixed(5);
+  static constexpr fixed_t ballMaxXSpeed = toFixed(5);
+};
+
+// 2" ST7789 modules, in portrait
+struct St7789Portrait240x320 {
+  static constexpr int width = 240;
+  static constexpr int height = 320;
+  static constexpr uint8_t rotation = 0;
+  static constexpr int paddleWidth = 48;
+  static constexpr int paddleHeight = 6;
+  static constexpr int paddleSpeed = 5;
+  static constexpr int ballSize = 10;
+  static constexpr fixed_t ballSpeed = toFixed(3);
+  static constexpr fixed_t ballMaxSpeed = toFixed(7);
+  static constexpr fixed_t ballMaxXSpeed = toFixed(7);
+};
+
+// Sizes worked out from a profile, checked once here instead of wherever
+// they're used
+template<typename Profile>
+struct BoardGeometry : Profile {
+  static constexpr int centerX = Profile::width / 2;
+  static constexpr int centerY = Profile::height / 2;
+  static constexpr int paddleHalfWidth = Profile::paddleWidth / 2;
+  static constexpr fixed_t ballHalfSize = toFixed(Profile::ballSize) / 2;
+
+  static_assert(Profile::rotation < 4, "Rotation is one of the four TFT_eSPI rotations");
+  static_assert(Profile::paddleWidth >= 2 && Profile::paddleWidth < Profile::width, "The paddle has to fit the field");
+  static_assert(Profile::ballSize < Profile::width && Profile::ballSize * 2 < Profile::height, "The ball has to fit the field");
+  static_assert(Profile::ballSpeed > 0 && Profile::ballSpeed <= Profile::ballMaxSpeed, "Serves can't be faster than rallies");
+  // Positions are Q8.8 in an int32_t
+  static_assert(toFixed(Profile::width) > 0 && toFixed(Profile::height) > 0, "The field has to fit fixed point");
+};
+
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE St7789Portrait135x240
+#endif
+
+typedef BoardGeometry<BOARD_PROFILE> Board;
+
+// TFT_eSPI is set up for the panel unrotated, rotations 1 and 3 swap it
+#ifdef TFT_WIDTH
+static_assert(Board::rotation % 2 ?
+    Board::width == TFT_HEIGHT && Board::height == TFT_WIDTH :
+    Board::width == TFT_WIDTH && Board::height == TFT_HEIGHT,
+    "BOARD_PROFILE doesn't match the TFT_WIDTH and TFT_HEIGHT of the build");
+#endif
@@ -0,0 +1,24 @@
+#include "boot_profile.h"
+
+BootProfile bootProfile;
+
+BootProfile::BootProfile():
+    phases{},
+    ends{},
+    count(0) {}
+
+void BootProfile::mark(const char* phase) {
+  if (count == BOOT_PHASES) return;
+  phases[count] = phase;
+  ends[count] = micros();
+  count++;
+}
+
+void BootProfile::report(Print& out) {
+  out.printf("Boot phase           us    end us\n");
+  uint32_t start = 0;
+  for (int i = 0; i < count; i++) {
+    out.printf("%-14s %9u %9u\n", phases[i], ends[i] - start, ends[i]);
+    start = ends[i];
+  }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+
+#define BOOT_PHASES 16
+
+// Times boot from the start of the app (micros() at 0) to the first
+// playable frame, one phase per mark. Kept after boot so it can be printed
+// again over serial.
+class BootProfile {
+public:
+  BootProfile();
+  // Ends the current phase, named after what it did
+  void mark(const char* phase);
+  void report(Print& out);
+private:
+  const char* phases[BOOT_PHASES];
+  uint32_t ends[BOOT_PHASES];
+  int count;
+};
+
+extern BootProfile bootProfile;
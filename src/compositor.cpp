@@ -0,0 +1,341 @@
+#include <esp_heap_caps.h>
+#include "compositor.h"
+#include "heap_tracker.h"
+#include "metrics.h"
+
+static Counter pixelsPushed("render.pixels");
+static Counter regionsPushed("render.regions");
+
+static bool isEmpty(Rect r) {
+  return r.w <= 0 || r.h <= 0;
+}
+
+static bool isSame(Rect a, Rect b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+static bool contains(Rect outer, Rect inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.w <= outer.x + outer.w &&
+         inner.y + inner.h <= outer.y + outer.h;
+}
+
+Rect Compositor::intersection(Rect a, Rect b) {
+  int x0 = max(a.x, b.x);
+  int y0 = max(a.y, b.y);
+  int x1 = min(a.x + a.w, b.x + b.w);
+  int y1 = min(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+static Rect unite(Rect a, Rect b) {
+  int x0 = min(a.x, b.x);
+  int y0 = min(a.y, b.y);
+  int x1 = max(a.x + a.w, b.x + b.w);
+  int y1 = max(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// Splits the part of a that is outside of b in up to four rectangles: a band
+// above b, a band below it, and the pieces left and right of b in between
+static int subtract(Rect a, Rect b, Rect* pieces) {
+  Rect overlap = Compositor::intersection(a, b);
+  if (isEmpty(overlap)) {
+    pieces[0] = a;
+    return 1;
+  }
+  int count = 0;
+  if (overlap.y > a.y) pieces[count++] = {a.x, a.y, a.w, overlap.y - a.y};
+  if (overlap.y + overlap.h < a.y + a.h) {
+    pieces[count++] = {a.x, overlap.y + overlap.h, a.w, a.y + a.h - overlap.y - overlap.h};
+  }
+  if (overlap.x > a.x) pieces[count++] = {a.x, overlap.y, overlap.x - a.x, overlap.h};
+  if (overlap.x + overlap.w < a.x + a.w) {
+    pieces[count++] = {overlap.x + overlap.w, overlap.y, a.x + a.w - overlap.x - overlap.w, overlap.h};
+  }
+  return count;
+}
+
+Compositor::Compositor(Display* display):
+    display(display),
+    bgColor(BLACK),
+    spriteCount(0),
+    layerCount(0),
+    dirtyCount(0),
+    restoredPixels(0),
+    frameRestoredPixels(0),
+    overflow(false),
+    full(false),
+    band(nullptr),
+    staging{nullptr, nullptr},
+    bandHeight(0),
+    currentStaging(0),
+    buffered(false),
+    writing(false) {}
+
+bool Compositor::enableBuffering(int bandHeight) {
+#ifdef RECORDING_DISPLAY
+  (void) bandHeight;
+  Serial.println("Buffered rendering is not available with the recording display");
+  return false;
+#else
+  if (buffered) return true;
+
+  // Shrink the band until the sprite and both staging buffers fit next to the
+  // reserve, otherwise keep drawing directly to the panel
+  for (; bandHeight >= MIN_BAND_HEIGHT; bandHeight /= 2) {
+    size_t bufferSize = WINDOW_WIDTH * bandHeight * sizeof(uint16_t);
+    size_t needed = bufferSize * 3;
+    reportMemory(needed);
+    if (heap_caps_get_free_size(MALLOC_CAP_DMA) < needed + HEAP_RESERVE ||
+        heap_caps_get_largest_free_block(MALLOC_CAP_DMA) < bufferSize) {
+      continue;
+    }
+
+    HeapScope scope(HEAP_RENDER);
+    band = new TFT_eSprite(display);
+    band->setColorDepth(16);
+    staging[0] = (uint16_t*) heap_caps_malloc(bufferSize, MALLOC_CAP_DMA);
+    staging[1] = (uint16_t*) heap_caps_malloc(bufferSize, MALLOC_CAP_DMA);
+    if (band->createSprite(WINDOW_WIDTH, bandHeight) && staging[0] && staging[1] && display->initDMA()) {
+      this->bandHeight = bandHeight;
+      buffered = true;
+      Serial.printf("Buffered rendering enabled with %dpx bands\n", bandHeight);
+      return true;
+    }
+    disableBuffering();
+  }
+  Serial.println("Not enough heap for buffered rendering, drawing directly");
+  return false;
+#endif
+}
+
+void Compositor::disableBuffering() {
+  finish();
+  if (buffered) display->deInitDMA();
+  if (band) {
+    band->deleteSprite();
+    delete band;
+    band = nullptr;
+  }
+  for (int i = 0; i < 2; i++) {
+    heap_caps_free(staging[i]);
+    staging[i] = nullptr;
+  }
+  buffered = false;
+}
+
+bool Compositor::isBuffered() {
+  return buffered;
+}
+
+void Compositor::finish() {
+  if (!writing) return;
+  display->dmaWait();
+  display->endWrite();
+  writing = false;
+}
+
+int Compositor::addSprite(uint16_t color) {
+  if (spriteCount == MAX_SPRITES) return -1;
+  sprites[spriteCount] = {{0, 0, 0, 0}, {0, 0, 0, 0}, color};
+  return spriteCount++;
+}
+
+void Compositor::moveSprite(int sprite, Rect rect) {
+  sprites[sprite].rect = rect;
+}
+
+int Compositor::addLayer(LayerPainter painter, void* context) {
+  if (layerCount == MAX_LAYERS) return -1;
+  layers[layerCount] = {{0, 0, 0, 0}, painter, context};
+  return layerCount++;
+}
+
+void Compositor::setLayerBounds(int layer, Rect bounds) {
+  if (isSame(layers[layer].bounds, bounds)) return;
+  addDirty(layers[layer].bounds);
+  layers[layer].bounds = bounds;
+  addDirty(bounds);
+}
+
+void Compositor::invalidate(Rect rect) {
+  addDirty(rect);
+}
+
+void Compositor::invalidate() {
+  full = true;
+}
+
+void Compositor::flush() {
+  for (int i = 0; i < spriteCount; i++) {
+    Sprite& sprite = sprites[i];
+    if (full) {
+      addDirty(sprite.drawn);
+      addDirty(sprite.rect);
+    } else if (!isSame(sprite.rect, sprite.drawn)) {
+      // Only the trailing strip needs erasing and the leading strip drawing
+      addDifference(sprite.drawn, sprite.rect);
+      addDifference(sprite.rect, sprite.drawn);
+    }
+    sprite.drawn = sprite.rect;
+  }
+  if (full) {
+    for (int i = 0; i < layerCount; i++) addDirty(layers[i].bounds);
+  }
+
+  mergeDirty();
+  finish();
+  if (buffered && dirtyCount > 0) {
+    // The bus stays claimed until the last transfer is done, see finish()
+    display->startWrite();
+    writing = true;
+  }
+  restoredPixels = 0;
+  for (int i = 0; i < dirtyCount; i++) {
+    paint(dirty[i]);
+    pixelsPushed.add(dirty[i].w * dirty[i].h);
+  }
+  regionsPushed.add(dirtyCount);
+  frameRestoredPixels = restoredPixels;
+  dirtyCount = 0;
+  overflow = false;
+  full = false;
+}
+
+void Compositor::blit(TFT_eSPI& canvas, int x, int y, int w, int h, uint16_t* pixels) {
+  // pushImage isn't virtual, so dispatch on the canvas the layer was given
+  if (&canvas == band) band->pushImage(x, y, w, h, pixels);
+  else display->pushImage(x, y, w, h, pixels);
+}
+
+uint32_t Compositor::getRestoredPixels() {
+  return frameRestoredPixels;
+}
+
+bool Compositor::intersects(Rect a, Rect b) {
+  return !isEmpty(intersection(a, b));
+}
+
+void Compositor::addDirty(Rect rect) {
+  rect = intersection(rect, {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT});
+  if (isEmpty(rect)) return;
+  if (overflow) {
+    dirty[0] = unite(dirty[0], rect);
+    return;
+  }
+
+  // Keep the dirty list disjoint so no pixel is pushed twice
+  for (int i = 0; i < dirtyCount; i++) {
+    if (!intersects(rect, dirty[i])) continue;
+    if (contains(dirty[i], rect)) return;
+    Rect pieces[4];
+    int count = subtract(rect, dirty[i], pieces);
+    for (int j = 0; j < count; j++) addDirty(pieces[j]);
+    return;
+  }
+
+  if (dirtyCount == MAX_DIRTY) {
+    // Too fragmented, repaint the bounding box of everything instead
+    for (int i = 1; i < dirtyCount; i++) dirty[0] = unite(dirty[0], dirty[i]);
+    dirty[0] = unite(dirty[0], rect);
+    dirtyCount = 1;
+    overflow = true;
+    return;
+  }
+  dirty[dirtyCount++] = rect;
+}
+
+void Compositor::addDifference(Rect a, Rect b) {
+  if (isEmpty(a)) return;
+  Rect pieces[4];
+  int count = subtract(a, b, pieces);
+  for (int i = 0; i < count; i++) addDirty(pieces[i]);
+}
+
+void Compositor::mergeDirty() {
+  // Rectangles are disjoint, so two of them form a rectangle when they share
+  // a full edge
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (int i = 0; i < dirtyCount && !merged; i++) {
+      for (int j = i + 1; j < dirtyCount && !merged; j++) {
+        Rect a = dirty[i];
+        Rect b = dirty[j];
+        bool vertical = a.x == b.x && a.w == b.w && (a.y + a.h == b.y || b.y + b.h == a.y);
+        bool horizontal = a.y == b.y && a.h == b.h && (a.x + a.w == b.x || b.x + b.w == a.x);
+        if (vertical || horizontal) {
+          dirty[i] = unite(a, b);
+          dirty[j] = dirty[--dirtyCount];
+          merged = true;
+        }
+      }
+    }
+  }
+}
+
+void Compositor::paint(Rect rect) {
+  if (buffered) {
+    paintBuffered(rect);
+    return;
+  }
+
+  int top = -1;
+  for (int i = spriteCount - 1; i >= 0 && top < 0; i--) {
+    if (intersects(sprites[i].rect, rect)) top = i;
+  }
+  if (top >= 0 && contains(sprites[top].rect, rect)) {
+    display->fillRect(rect.x, rect.y, rect.w, rect.h, sprites[top].color);
+    return;
+  }
+
+  bool layered = false;
+  for (int i = 0; i < layerCount && !layered; i++) {
+    layered = intersects(layers[i].bounds, rect);
+  }
+  if (!layered && top < 0) {
+    display->fillRect(rect.x, rect.y, rect.w, rect.h, bgColor);
+    return;
+  }
+
+  display->setViewport(rect.x, rect.y, rect.w, rect.h, false);
+  compose(*display, rect);
+  display->resetViewport();
+}
+
+void Compositor::paintBuffered(Rect rect) {
+  uint16_t* pixels = (uint16_t*) band->getPointer();
+  for (int y = rect.y; y < rect.y + rect.h; y += bandHeight) {
+    int h = min(bandHeight, rect.y + rect.h - y);
+
+    // Shift the band datum so layers keep drawing in screen coordinates
+    band->setViewport(0, -y, WINDOW_WIDTH, y + h, true);
+    compose(*band, {0, y, WINDOW_WIDTH, h});
+    band->resetViewport();
+
+    // The panel viewport crops the band to the dirty region, pushImageDMA
+    // copies that crop into the idle staging buffer before queueing it
+    display->setViewport(rect.x, y, rect.w, h, false);
+    display->pushImageDMA(0, y, WINDOW_WIDTH, h, pixels, staging[currentStaging]);
+    display->resetViewport();
+    currentStaging ^= 1;
+  }
+}
+
+void Compositor::compose(TFT_eSPI& canvas, Rect rect) {
+  canvas.fillRect(rect.x, rect.y, rect.w, rect.h, bgColor);
+  for (int i = 0; i < layerCount; i++) {
+    if (intersects(layers[i].bounds, rect)) restoredPixels += layers[i].painter(layers[i].context, canvas, rect);
+  }
+  for (int i = 0; i < spriteCount; i++) {
+    Rect overlap = intersection(sprites[i].rect, rect);
+    if (!isEmpty(overlap)) canvas.fillRect(overlap.x, overlap.y, overlap.w, overlap.h, sprites[i].color);
+  }
+}
+
+void Compositor::reportMemory(size_t needed) {
+  Serial.printf("Render buffers: %u bytes needed, %u free, largest DMA block %u, reserve %u\n",
+      needed, heap_caps_get_free_size(MALLOC_CAP_DMA),
+      heap_caps_get_largest_free_block(MALLOC_CAP_DMA), HEAP_RESERVE);
+}
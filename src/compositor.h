@@ -0,0 +1,82 @@
+#pragma once
+
+#include <TFT_eSPI.h>
+#include "display.h"
+#include "macros.h"
+#include "rect.h"
+
+#define MAX_SPRITES 4
+#define MAX_LAYERS 4
+#define MAX_DIRTY 32
+
+#define BAND_HEIGHT 16
+#define MIN_BAND_HEIGHT 4
+// Heap left untouched for Wi-Fi and ESP-NOW when sizing the render buffers
+#define HEAP_RESERVE (48 * 1024)
+
+// Restores the part of a static layer inside clip, in screen coordinates, and
+// returns how many pixels it restored. The canvas viewport is already clipped
+// to the region being repainted.
+typedef int (*LayerPainter)(void* context, TFT_eSPI& canvas, Rect clip);
+
+// Collects what changed on the playfield during a frame and repaints only
+// that. Sprites are opaque rectangles (ball and paddles) that are diffed
+// against their previous position, layers are static content (center line
+// and score) that is restored wherever a sprite uncovers it.
+//
+// With buffering enabled, regions are composed off-screen in a horizontal
+// band and pushed with DMA from alternating staging buffers, so the transfer
+// overlaps with the next simulation tick.
+class Compositor {
+public:
+  Compositor(Display* display);
+  bool enableBuffering(int bandHeight = BAND_HEIGHT);
+  void disableBuffering();
+  bool isBuffered();
+  void finish();
+  int addSprite(uint16_t color);
+  void moveSprite(int sprite, Rect rect);
+  int addLayer(LayerPainter painter, void* context);
+  void setLayerBounds(int layer, Rect bounds);
+  void invalidate(Rect rect);
+  void invalidate();
+  void flush();
+  void blit(TFT_eSPI& canvas, int x, int y, int w, int h, uint16_t* pixels);
+  uint32_t getRestoredPixels();
+  static bool intersects(Rect a, Rect b);
+  static Rect intersection(Rect a, Rect b);
+private:
+  typedef struct Sprite {
+    Rect rect;
+    Rect drawn;
+    uint16_t color;
+  } Sprite;
+
+  typedef struct Layer {
+    Rect bounds;
+    LayerPainter painter;
+    void* context;
+  } Layer;
+
+  Display* display;
+  uint16_t bgColor;
+  Sprite sprites[MAX_SPRITES];
+  Layer layers[MAX_LAYERS];
+  Rect dirty[MAX_DIRTY];
+  int spriteCount, layerCount, dirtyCount;
+  uint32_t restoredPixels, frameRestoredPixels;
+  bool overflow, full;
+
+  TFT_eSprite* band;
+  uint16_t* staging[2];
+  int bandHeight, currentStaging;
+  bool buffered, writing;
+
+  void addDirty(Rect rect);
+  void addDifference(Rect a, Rect b);
+  void mergeDirty();
+  void paint(Rect rect);
+  void paintBuffered(Rect rect);
+  void compose(TFT_eSPI& canvas, Rect rect);
+  void reportMemory(size_t needed);
+};
@@ -0,0 +1,117 @@
+#include <utility>
+#include "controls.h"
+#include "metrics.h"
+
+static Counter edgesAccepted("input.edges");
+static Gauge eventsDropped("input.dropped");
+
+Controls::Controls():
+    lines{},
+    gestures{},
+    chord{nullptr, nullptr},
+    edgeListener(nullptr),
+    edgeContext(nullptr) {}
+
+void Controls::begin(uint8_t lPin, uint8_t lMode, uint8_t rPin, uint8_t rMode) {
+  const uint8_t pins[BUTTON_COUNT] = {lPin, rPin};
+  const uint8_t modes[BUTTON_COUNT] = {lMode, rMode};
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    Line& line = lines[i];
+    pinMode(pins[i], modes[i]);
+    // Both buttons are active low
+    line = {this, (Button) i, pins[i], digitalRead(pins[i]) == LOW, false, false, (uint32_t) micros()};
+    // Held at boot, so it can't count as a press
+    line.ignored = line.pressed;
+    attachInterruptArg(digitalPinToInterrupt(pins[i]), Controls::handleEdge, &line, CHANGE);
+  }
+}
+
+void IRAM_ATTR Controls::handleEdge(void* context) {
+  Line* line = static_cast<Line*>(context);
+  line->controls->queue.push({(uint32_t) micros(), line->button, digitalRead(line->pin) == LOW});
+}
+
+void Controls::poll() {
+  ButtonEvent event;
+  while (queue.pop(event)) {
+    Line& line = lines[event.button];
+    if (event.pressed == line.pressed || event.time - line.changedAt < DEBOUNCE_US) continue;
+    accept(line, event.pressed, event.time);
+  }
+  eventsDropped.set(queue.getDropped());
+
+  uint32_t now = micros();
+  for (Line& line : lines) {
+    // Bouncing can settle after the last edge that got through, so the pin
+    // has the final word once the debounce time has passed
+    bool pressed = digitalRead(line.pin) == LOW;
+    if (pressed != line.pressed && now - line.changedAt >= DEBOUNCE_US) accept(line, pressed, now);
+  }
+
+  for (Line& line : lines) {
+    if (!line.pressed || line.ignored || line.longPressed) continue;
+    if (now - line.changedAt < LONG_PRESS_MS * 1000) continue;
+    line.longPressed = true;
+    fire(gestures[line.button][LONG_PRESS]);
+  }
+
+  Line& left = lines[LEFT_BUTTON];
+  Line& right = lines[RIGHT_BUTTON];
+  if (chord.handler && left.pressed && right.pressed && !left.ignored && !right.ignored) {
+    uint32_t first = left.changedAt;
+    uint32_t last = right.changedAt;
+    if ((int32_t) (last - first) < 0) std::swap(first, last);
+    if (last - first < CHORD_SKEW_MS * 1000 && now - last >= CHORD_MS * 1000) {
+      left.ignored = true;
+      right.ignored = true;
+      fire(chord);
+    }
+  }
+}
+
+void Controls::accept(Line& line, bool pressed, uint32_t time) {
+  line.pressed = pressed;
+  line.changedAt = time;
+  edgesAccepted.add();
+  if (edgeListener) edgeListener(edgeContext, {time, line.button, pressed});
+  if (pressed) {
+    line.longPressed = false;
+    return;
+  }
+  bool clicked = !line.ignored && !line.longPressed;
+  line.ignored = false;
+  if (clicked) fire(gestures[line.button][CLICK]);
+}
+
+void Controls::fire(const Binding& binding) {
+  if (binding.handler) binding.handler(binding.context);
+}
+
+void Controls::setEdgeListener(EdgeHandler handler, void* context) {
+  edgeListener = handler;
+  edgeContext = context;
+}
+
+void Controls::attach(Button button, Gesture gesture, ControlHandler handler, void* context) {
+  gestures[button][gesture] = {handler, context};
+}
+
+void Controls::attachChord(ControlHandler handler, void* context) {
+  chord = {handler, context};
+}
+
+void Controls::clear() {
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    for (int j = 0; j < GESTURE_COUNT; j++) gestures[i][j] = {nullptr, nullptr};
+    lines[i].ignored = lines[i].pressed;
+  }
+  chord = {nullptr, nullptr};
+}
+
+bool Controls::isPressed(Button button) {
+  return lines[button].pressed;
+}
+
+uint32_t Controls::getDropped() {
+  return queue.getDropped();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+#include "spsc_queue.h"
+
+// Must be a power of two
+#define INPUT_QUEUE_SIZE 64
+// Edges closer than this to the last accepted one are contact bounce
+#define DEBOUNCE_US 5000
+#define LONG_PRESS_MS 800
+// Both buttons held this long, pressed within CHORD_SKEW_MS of each other
+#define CHORD_MS 2000
+#define CHORD_SKEW_MS 100
+
+enum Button : uint8_t {
+  LEFT_BUTTON,
+  RIGHT_BUTTON,
+  BUTTON_COUNT
+};
+
+enum Gesture : uint8_t {
+  // Released before it became a long press
+  CLICK,
+  // Held for LONG_PRESS_MS, fires once per press
+  LONG_PRESS,
+  GESTURE_COUNT
+};
+
+typedef struct ButtonEvent {
+  uint32_t time; // micros()
+  Button button;
+  bool pressed;
+} ButtonEvent;
+
+typedef void (*ControlHandler)(void* context);
+typedef void (*EdgeHandler)(void* context, const ButtonEvent& event);
+
+// Filled from the GPIO interrupt and drained by the loop
+typedef SpscQueue<ButtonEvent, INPUT_QUEUE_SIZE> EventQueue;
+
+// Both buttons, captured on every edge by interrupt so nothing is missed
+// while the loop is busy, and debounced as the queue is drained. Raw edges
+// go to a single listener with their timestamps, clicks, long presses and
+// the two button chord go to handlers that can be swapped without touching
+// the edge listener.
+class Controls {
+public:
+  Controls();
+  void begin(uint8_t lPin, uint8_t lMode, uint8_t rPin, uint8_t rMode);
+  // Drains the queue and fires whatever gestures completed
+  void poll();
+  void setEdgeListener(EdgeHandler handler, void* context);
+  void attach(Button button, Gesture gesture, ControlHandler handler, void* context);
+  void attachChord(ControlHandler handler, void* context);
+  // Detaches every gesture, and presses in progress are ignored until they
+  // are released, so a held button can't fire into whatever is attached next
+  void clear();
+  bool isPressed(Button button);
+  uint32_t getDropped();
+private:
+  typedef struct Binding {
+    ControlHandler handler;
+    void* context;
+  } Binding;
+
+  typedef struct Line {
+    Controls* controls;
+    Button button;
+    uint8_t pin;
+    // Debounced state, only touched by the loop
+    bool pressed;
+    bool ignored;
+    bool longPressed;
+    uint32_t changedAt;
+  } Line;
+
+  EventQueue queue;
+  Line lines[BUTTON_COUNT];
+  Binding gestures[BUTTON_COUNT][GESTURE_COUNT];
+  Binding chord;
+  EdgeHandler edgeListener;
+  void* edgeContext;
+
+  void accept(Line& line, bool pressed, uint32_t time);
+  void fire(const Binding& binding);
+  static void IRAM_ATTR handleEdge(void* context);
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <TFT_eSPI.h>
+
+#ifdef RECORDING_DISPLAY
+#include "recording_display.h"
+typedef RecordingDisplay Display;
+#else
+typedef TFT_eSPI Display;
+#endif
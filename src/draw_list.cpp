@@ -0,0 +1,97 @@
+#include "draw_list.h"
+
+DrawList::DrawList():
+    pending{},
+    submitted(0),
+    released(0),
+    reported(0) {}
+
+void DrawList::moveSprite(int sprite, Rect rect) {
+  add({DRAW_SPRITE, (uint8_t) sprite, (int16_t) rect.x, (int16_t) rect.y, (int16_t) rect.w, (int16_t) rect.h});
+}
+
+void DrawList::setScore(int side, int score) {
+  add({DRAW_SCORE, (uint8_t) side, (int16_t) score, 0, 0, 0});
+}
+
+void DrawList::invalidate(Rect rect) {
+  add({DRAW_INVALIDATE, 0, (int16_t) rect.x, (int16_t) rect.y, (int16_t) rect.w, (int16_t) rect.h});
+}
+
+void DrawList::redraw() {
+  add({DRAW_REDRAW, 0, 0, 0, 0, 0});
+}
+
+void DrawList::setTrace(uint16_t trace) {
+  // The older press is the one that has waited longer to be drawn
+  if (!pending.trace) pending.trace = trace;
+}
+
+void DrawList::add(DrawCommand command) {
+  bool redrawing = false;
+  for (int i = 0; i < pending.count; i++) {
+    DrawCommand& other = pending.commands[i];
+    if (other.op == DRAW_REDRAW) redrawing = true;
+    // Sprites and scores only need their latest state
+    if ((command.op == DRAW_SPRITE || command.op == DRAW_SCORE) && other.op == command.op && other.id == command.id) {
+      other = command;
+      return;
+    }
+  }
+  if (command.op == DRAW_INVALIDATE || command.op == DRAW_REDRAW) {
+    // A full repaint covers every region
+    if (redrawing) return;
+    if (command.op == DRAW_INVALIDATE && pending.count < MAX_DRAW_COMMANDS) {
+      pending.commands[pending.count++] = command;
+    } else {
+      replaceRegions();
+    }
+    return;
+  }
+  // There are only a few sprites and scores, so the room is taken by regions
+  if (pending.count == MAX_DRAW_COMMANDS) replaceRegions();
+  pending.commands[pending.count++] = command;
+}
+
+void DrawList::replaceRegions() {
+  int count = 0;
+  for (int i = 0; i < pending.count; i++) {
+    if (pending.commands[i].op != DRAW_INVALIDATE) pending.commands[count++] = pending.commands[i];
+  }
+  pending.count = count;
+  pending.commands[pending.count++] = {DRAW_REDRAW, 0, 0, 0, 0, 0};
+}
+
+bool DrawList::submit() {
+  if (!pending.count && !pending.trace) return true;
+  uint32_t at = submitted.load(std::memory_order_relaxed);
+  // A slot is only reused once its report was taken
+  if (at - reported == DRAW_FRAMES) return false;
+  frames[at % DRAW_FRAMES] = pending;
+  submitted.store(at + 1, std::memory_order_release);
+  pending.count = 0;
+  pending.trace = 0;
+  return true;
+}
+
+bool DrawList::takeDrawn(DrawnFrame& frame) {
+  if (reported == released.load(std::memory_order_acquire)) return false;
+  frame = drawn[reported++ % DRAW_FRAMES];
+  return true;
+}
+
+bool DrawList::isDrained() {
+  return released.load(std::memory_order_acquire) == submitted.load(std::memory_order_relaxed);
+}
+
+const DrawFrame* DrawList::peek() {
+  uint32_t at = released.load(std::memory_order_relaxed);
+  if (at == submitted.load(std::memory_order_acquire)) return nullptr;
+  return &frames[at % DRAW_FRAMES];
+}
+
+void DrawList::release(uint32_t drawnAt) {
+  uint32_t at = released.load(std::memory_order_relaxed);
+  drawn[at % DRAW_FRAMES] = {frames[at % DRAW_FRAMES].trace, drawnAt};
+  released.store(at + 1, std::memory_order_release);
+}
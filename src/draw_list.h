@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "rect.h"
+
+// Frames submitted and not yet drawn, the simulation keeps merging into its
+// pending frame while they are all taken
+#define DRAW_FRAMES 4
+#define MAX_DRAW_COMMANDS 16
+
+enum DrawOp : uint8_t {
+  // Moves sprite id to x, y, w, h
+  DRAW_SPRITE,
+  // Shows score x for side id
+  DRAW_SCORE,
+  // Repaints x, y, w, h
+  DRAW_INVALIDATE,
+  // Repaints the whole playfield
+  DRAW_REDRAW,
+};
+
+typedef struct DrawCommand {
+  uint8_t op;
+  uint8_t id;
+  int16_t x, y, w, h;
+} DrawCommand;
+
+typedef struct DrawFrame {
+  // The press whose move this frame shows, 0 if none
+  uint16_t trace;
+  uint8_t count;
+  DrawCommand commands[MAX_DRAW_COMMANDS];
+} DrawFrame;
+
+// When a frame went out, reported back so the simulation task can follow
+// presses without sharing the tracer with the render task
+typedef struct DrawnFrame {
+  uint16_t trace;
+  uint32_t time;
+} DrawnFrame;
+
+// Hands what changed on the playfield from the simulation task to the render
+// task. The simulation builds a frame of commands and submits it once per
+// tick, the render task draws frames in order and reports each one back.
+// Neither side ever waits on the other: when every frame is still taken the
+// commands stay pending and the next tick's are merged into them, a sprite
+// only keeping its latest position and a score its latest value.
+class DrawList {
+public:
+  DrawList();
+  // Simulation task
+  void moveSprite(int sprite, Rect rect);
+  void setScore(int side, int score);
+  void invalidate(Rect rect);
+  void redraw();
+  void setTrace(uint16_t trace);
+  // False when the render task is behind, the frame stays pending
+  bool submit();
+  bool takeDrawn(DrawnFrame& drawn);
+  // Every submitted frame was drawn and reported back
+  bool isDrained();
+  // Render task
+  const DrawFrame* peek();
+  void release(uint32_t drawnAt);
+private:
+  DrawFrame pending;
+  DrawFrame frames[DRAW_FRAMES];
+  DrawnFrame drawn[DRAW_FRAMES];
+  // Frames submitted and drawn, and reports taken back, counted since the start
+  std::atomic<uint32_t> submitted, released;
+  uint32_t reported;
+
+  void add(DrawCommand command);
+  // Turns every pending region into a single full repaint
+  void replaceRegions();
+};
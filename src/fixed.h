@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Q8.8 fixed point. Only integer adds, multiplies, divisions and arithmetic
+// shifts are used, so both boards compute bit-identical results, which the
+// network sync relies on.
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT 8
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+constexpr fixed_t toFixed(int value) {
+  return value * FIXED_ONE;
+}
+
+// Rounds towards negative infinity, so positions don't bunch up around 0
+constexpr int fromFixed(fixed_t value) {
+  return value >> FIXED_SHIFT;
+}
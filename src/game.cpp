@@ -5,154 +5,277 @@
 #include <freertos/semphr.h>
 
 #include "ball.h"
+#include "boot_profile.h"
 #include "game.h"
+#include "heap_tracker.h"
 #include "macros.h"
 #include "menu.h"
+#include "metrics.h"
 #include "network.h"
 #include "paddle.h"
 #include "player.h"
-
-TFT_eSPI Game::tft = TFT_eSPI();
-Game* Game::instance = nullptr;
+#include "trace_log.h"
+
+#ifdef RECORDING_DISPLAY
+TFT_eSPI panel = TFT_eSPI();
+Display Game::tft(&panel);
+#else
+Display Game::tft = TFT_eSPI();
+#endif
+
+static const uint32_t renderBounds[] = {250, 500, 1000, 2000, 4000, 8000, 16000, 33000};
+static const uint32_t stepBounds[] = {5, 10, 20, 50, 100, 200, 500};
+
+static Counter framesRendered("render.frames");
+static Histogram renderTime("render.time_us", renderBounds);
+static Counter framesMerged("render.merged");
+static Counter ticksStepped("physics.ticks");
+static Histogram stepTime("physics.time_us", stepBounds);
+static Counter ballCorrections("physics.corrections");
+static Counter ticksReceived("net.ticks_applied");
+static Counter ticksMissed("net.ticks_missed");
 
 Game::Game():
-    tickCount(0),
     field(nullptr),
     ball(nullptr),
+    network(nullptr),
     menu(nullptr),
     uPlayer(nullptr),
     dPlayer(nullptr),
     isMultiplayer(false),
-    lastRemoteTick(0),
-    isHost(false),
     paused(false),
-    lButton(nullptr),
-    rButton(nullptr),
+    scene(Scene::PLAYING),
+    sceneStart(0),
+    sceneDuration(0),
+    scoredPlayer(0),
+    controls(nullptr),
+    drawnTrace(0),
+    sentTrace(0),
+    drawnScores{-1, -1},
+    rendering(false),
+    frameListener(nullptr),
+    frameContext(nullptr),
     peerMac{0} {
-  if (instance) {
-    // Crash if there is more than one instance
-    Game::tft.fillScreen(RED);
-    while (1) {}
+  // Network and Menu are only created once they are first needed, see
+  // getNetwork() and getMenu()
+  HeapScope scope(HEAP_GAME);
+  {
+    HeapScope renderScope(HEAP_RENDER);
+    graphics = new Graphics();
+    compositor = new Compositor(&Game::tft);
+    field = new Field();
+  }
+  initState(state, random(1, INT32_MAX));
+  {
+    HeapScope replayScope(HEAP_REPLAY);
+    recorder = new ReplayRecorder(REPLAY_RING_SIZE);
+    recorder->keyframe(state, sync);
   }
-  instance = this;
-  network = new Network(this);
-  graphics = new Graphics();
-  field = new Field();
-  ball = new Ball(8);
-  menu = new Menu(this);
+  tracer = new LatencyTracer();
   uPlayer = new Player(Side::UP);
   dPlayer = new Player(Side::DOWN);
-  Paddle* uPaddle = new Paddle(WINDOW_WIDTH / 2);
-  Paddle* dPaddle = new Paddle(WINDOW_WIDTH / 2);
-  
-  uPlayer->setPaddle(uPaddle);
-  uPaddle->setPlayer(uPlayer);
-  
-  dPlayer->setPaddle(dPaddle);
-  dPaddle->setPlayer(dPlayer);
-  
-  ball->setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
-
+  dPlayer->setTracer(tracer);
+  uPaddle = new Paddle(&state.paddles[UP_PADDLE], UP_PADDLE, compositor->addSprite(WHITE));
+  dPaddle = new Paddle(&state.paddles[DOWN_PADDLE], DOWN_PADDLE, compositor->addSprite(WHITE));
+  ball = new Ball(&state.ball, compositor->addSprite(WHITE));
+  bootProfile.mark("objects");
+
+  int fieldLayer = compositor->addLayer(Game::paintField, this);
+  compositor->setLayerBounds(fieldLayer, field->getBounds());
+  uScoreLayer = compositor->addLayer(Game::paintUScore, this);
+  dScoreLayer = compositor->addLayer(Game::paintDScore, this);
+  ScoreGlyphs::rasterize();
+  bootProfile.mark("glyphs");
+
+  // Until the render task starts, frames are drawn right away
   initialRender();
+  bootProfile.mark("first frame");
+}
+
+// Called on every pass of the loop, so button events are handled and timed
+// scenes advance independently of the update rate
+void Game::poll() {
+  controls->poll();
+  if (network) network->poll();
+  updateScene();
 }
 
 void Game::tick() {
-  this->lButton->tick();
-  this->rButton->tick();
-  if (paused) return;
+  if (paused || scene != Scene::PLAYING) return;
+  const Inputs local = {{uPlayer->getInput(), dPlayer->getInput()}};
+  Inputs inputs = local;
+  int remotePoint = 0;
   if (isMultiplayer) {
-    bool ticked = false;
-    SemaphoreHandle_t mutex = network->getRemoteTickMutex();
-    if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-      RemoteTick* remoteTick = network->receiveTick();
-      if (remoteTick != nullptr) {
-        uPlayer->tick(remoteTick);
-        syncGame(remoteTick);
-        ticked = true;
-        if (remoteTick->scored) {
-          Serial.println("Remote should have scored");
-        }
+    // Handed over by poll() earlier in this pass of the loop, a missed tick
+    // is caught up by the next one
+    RemoteTick* remoteTick = network->receiveTick();
+    if (remoteTick != nullptr) {
+      uint32_t arrival = network->getTickArrival();
+      uint32_t age = (micros() - arrival) / 1000;
+      recorder->remote(*remoteTick, age > UINT16_MAX ? UINT16_MAX : age);
+      tracer->received(*remoteTick, arrival);
+      SyncResult synced = syncGame(*remoteTick);
+      inputs.moves[UP_PADDLE] = synced.remoteMove;
+      remotePoint = synced.scored;
+      ticksReceived.add();
+      if (remoteTick->scored) {
+        logEvent<LOG_REMOTE_SCORED>();
       }
-      if (!ticked) {
-        Serial.println("Failed to receive remote tick");
-        uPlayer->tick();
-      }
-      xSemaphoreGive(mutex);
+    } else {
+      logEvent<LOG_TICK_MISSED>();
+      ticksMissed.add();
     }
   }
-  dPlayer->tick();
-  int scoredPlayer = ball->tick();
-  int angle = 1024;
-  if (ball->getDirection() == Side::UP) {
-    angle = uPlayer->bounce(ball);
-  } else if (ball->getDirection() == Side::DOWN) {
-    angle = dPlayer->bounce(ball);
-  }
-  if (angle != 1024) {
-    ball->bounce(angle);
+  int32_t paddlePos = state.paddles[DOWN_PADDLE].pos;
+  uint32_t stepStart = micros();
+  int scored = step(state, inputs);
+  stepTime.record(micros() - stepStart);
+  // The joiner's ball only follows the host's, so are its points
+  if (isMultiplayer && !sync.getIsHost()) scored = remotePoint;
+  ticksStepped.add();
+  recorder->tick(local, state, sync);
+  // A press is followed until the first tick that actually moves the paddle,
+  // a short one may take a few to add up to a pixel
+  uint16_t trace = dPlayer->getTrace();
+  if (trace && state.paddles[DOWN_PADDLE].pos != paddlePos) {
+    dPlayer->clearTrace();
+    tracer->mark(trace, STAGE_STEPPED, micros());
+    drawnTrace = trace;
+    sentTrace = trace;
   }
-  if (scoredPlayer) {
-    Serial.printf("Scored player: %d\n", scoredPlayer);
-    score(scoredPlayer);
+  if (scored) {
+    logEvent<LOG_SCORED>(scored);
+    score(scored);
   }
-  tickCount++;
   if (isMultiplayer) {
-    network->sendTick(getRemoteTick(scoredPlayer));
+    RemoteTick remoteTick = sync.makeTick(state, scored);
+    // Repeated until the next press, in case this tick gets lost
+    remoteTick.trace = sentTrace;
+    tracer->fillEcho(remoteTick, micros());
+    network->sendTick(remoteTick);
+    tracer->mark(sentTrace, STAGE_SENT, micros());
   }
 }
 
 void Game::render() {
+  // The tracer is only used from this task, so drawn frames are reported
+  // back here
+  DrawnFrame drawn;
+  while (drawList.takeDrawn(drawn)) {
+    tracer->mark(drawn.trace, STAGE_DRAWN, drawn.time);
+    tracer->remoteDrawn(drawn.time);
+  }
   if (paused) return;
-  uPlayer->render();
-  dPlayer->render();
-  if (ball->isInCenter(30)) {
-    field->render();
-    renderScore();
+  draw();
+}
+
+void Game::startRendering() {
+  rendering = startTask("render", Game::renderTask, this, RENDER_STACK, RENDER_PRIORITY, RENDER_CORE);
+  if (!rendering) Serial.println("Failed to start the render task, drawing in the loop");
+}
+
+void Game::setFrameListener(FrameListener listener, void* context) {
+  frameListener = listener;
+  frameContext = context;
+}
+
+void Game::renderTask(void* context) {
+  Game* game = static_cast<Game*>(context);
+  for (;;) {
+    game->drawSignal.take();
+    game->drawSubmitted();
+  }
+}
+
+void Game::drawSubmitted() {
+  const DrawFrame* frame;
+  while ((frame = drawList.peek()) != nullptr) {
+    uint32_t start = micros();
+    drawFrame(*frame);
+    if (frameListener) frameListener(frameContext);
+    // With buffered rendering the last band may still be on its way over DMA
+    uint32_t now = micros();
+    framesRendered.add();
+    renderTime.record(now - start);
+    drawList.release(now);
+  }
+}
+
+void Game::drawFrame(const DrawFrame& frame) {
+  for (int i = 0; i < frame.count; i++) {
+    const DrawCommand& command = frame.commands[i];
+    Rect rect = {command.x, command.y, command.w, command.h};
+    switch (command.op) {
+      case DRAW_SPRITE:
+        compositor->moveSprite(command.id, rect);
+        break;
+      case DRAW_SCORE:
+        showScore((PaddleSlot) command.id, command.x);
+        break;
+      case DRAW_INVALIDATE:
+        compositor->invalidate(rect);
+        break;
+      case DRAW_REDRAW:
+        compositor->invalidate();
+        break;
+    }
   }
-  ball->render();
+  compositor->flush();
+}
+
+void Game::finishFrames() {
+  if (!rendering) drawSubmitted();
+  while (!drawList.isDrained()) delay(1);
+  compositor->finish();
 }
 
 Menu* Game::getMenu() {
+  if (!menu) {
+    HeapScope scope(HEAP_MENU);
+    menu = new Menu(this);
+    menu->setControls(controls);
+  }
   return menu;
 }
 
 void Game::initialRender() {
-  ball->render();
-  uPlayer->render(true);
-  dPlayer->render(true);
-  renderScore();
-  field->render();
+  updateScores();
+  drawList.redraw();
+  draw();
 }
 
-void Game::setControls(OneButton* lButton, OneButton* rButton) {
-  this->lButton = lButton;
-  this->rButton = rButton;
-
-  this->lButton->attachDuringLongPress(Game::handleOpenMenu, this);
-  this->rButton->attachDuringLongPress(Game::handleOpenMenu, this);
+void Game::draw() {
+  uPaddle->render(&drawList);
+  dPaddle->render(&drawList);
+  ball->render(&drawList);
+  drawList.setTrace(drawnTrace);
+  drawnTrace = 0;
+  // When the render task is behind, this frame is merged into the next one
+  // instead of holding up the tick
+  if (!drawList.submit()) {
+    framesMerged.add();
+    return;
+  }
+  if (rendering) drawSignal.give();
+  else drawSubmitted();
+}
 
-  dPlayer->setControls(this->lButton, this->rButton);
-  menu->setControls(this->lButton, this->rButton);
+void Game::setControls(Controls* controls) {
+  this->controls = controls;
+  // Holding both buttons opens the menu
+  controls->attachChord(Game::handleOpenMenu, this);
+  dPlayer->setControls(controls);
+  if (menu) menu->setControls(controls);
 }
 
 void Game::handleOpenMenu(void *context) {
   Game* game = static_cast<Game*>(context);
-  OneButton* lButton = game->getLButton();
-  OneButton* rButton = game->getRButton();
-  if (lButton->getPressedMs() >= 2000 && rButton->getPressedMs() >= 2000 &&
-      abs((int) lButton->getPressedMs() - (int) rButton->getPressedMs()) < 100) {
-    Serial.println("Open menu");
-    game->getMenu()->setCurrentMenu(MENU_MAIN);
-    game->getMenu()->open();
-  }
+  Serial.println("Open menu");
+  game->getMenu()->open(MENU_MAIN);
 }
 
-OneButton* Game::getLButton() {
-  return lButton;
-}
-
-OneButton* Game::getRButton() {
-  return rButton;
+Controls* Game::getControls() {
+  return controls;
 }
 
 Graphics* Game::getGraphics() {
@@ -160,39 +283,135 @@ Graphics* Game::getGraphics() {
 }
 
 Network* Game::getNetwork() {
+  if (!network) {
+    HeapScope scope(HEAP_NETWORK);
+    network = new Network(this);
+  }
   return network;
 }
 
-void Game::renderScore() {
-  int u_score_int = uPlayer->getScore();
-  int d_score_int = dPlayer->getScore();
-  String u_score = String(u_score_int);
-  String d_score = String(d_score_int);
-  Game::tft.drawString(u_score, 10, WINDOW_HEIGHT / 2 - 20);
-  Game::tft.drawString(d_score, WINDOW_WIDTH - (d_score.length() * 2) - 15, WINDOW_HEIGHT / 2 + 20);
+Compositor* Game::getCompositor() {
+  return compositor;
+}
+
+GameState& Game::getState() {
+  return state;
+}
+
+ReplayRecorder* Game::getRecorder() {
+  return recorder;
+}
+
+LatencyTracer* Game::getTracer() {
+  return tracer;
+}
+
+int Game::renderScore(TFT_eSPI& canvas, Side side, Rect clip) {
+  ScoreGlyphs& glyphs = side == Side::UP ? uScore : dScore;
+  Rect bounds = getScoreBounds(side);
+  Rect restored = Compositor::intersection(bounds, clip);
+  if (restored.w == bounds.w && restored.h == bounds.h) {
+    compositor->blit(canvas, bounds.x, bounds.y, bounds.w, bounds.h, glyphs.getPixels());
+    return bounds.w * bounds.h;
+  }
+
+  // Only the digit cells the clip actually touches are restored
+  int pixels = 0;
+  for (int i = 0; i < glyphs.getLength(); i++) {
+    Rect cell = {bounds.x + i * GLYPH_WIDTH, bounds.y, GLYPH_WIDTH, GLYPH_HEIGHT};
+    restored = Compositor::intersection(cell, clip);
+    if (restored.w <= 0 || restored.h <= 0) continue;
+    compositor->blit(canvas, cell.x, cell.y, cell.w, cell.h, glyphs.getDigitPixels(i));
+    pixels += restored.w * restored.h;
+  }
+  return pixels;
+}
+
+void Game::updateScores() {
+  // Glyph bitmaps are only rebuilt, and the score only repainted, when a
+  // score actually changed
+  for (int i = 0; i < PADDLE_COUNT; i++) {
+    if (state.scores[i] == drawnScores[i]) continue;
+    drawnScores[i] = state.scores[i];
+    drawList.setScore(i, state.scores[i]);
+  }
+}
+
+void Game::showScore(PaddleSlot slot, int score) {
+  Side side = slot == UP_PADDLE ? Side::UP : Side::DOWN;
+  ScoreGlyphs& glyphs = side == Side::UP ? uScore : dScore;
+  if (!glyphs.setScore(score)) return;
+  compositor->setLayerBounds(side == Side::UP ? uScoreLayer : dScoreLayer, getScoreBounds(side));
+  compositor->invalidate(getScoreBounds(side));
+}
+
+Rect Game::getScoreBounds(Side side) {
+  if (side == Side::UP) return {10, Board::centerY - 20, uScore.getWidth(), uScore.getHeight()};
+  int x = WINDOW_WIDTH - dScore.getLength() * 2 - 15;
+  return {x, Board::centerY + 20, dScore.getWidth(), dScore.getHeight()};
 }
 
 void Game::setDScore(int score) {
-  dPlayer->setScore(score);
+  state.scores[DOWN_PADDLE] = score;
+  updateScores();
 }
 
 void Game::setUScore(int score) {
-  uPlayer->setScore(score);
+  state.scores[UP_PADDLE] = score;
+  updateScores();
 }
 
 void Game::score(int player) {
-  delay(1000);
-  if (player < 0) {
-    setUScore(uPlayer->getScore() + 1);
-  } else if (player > 0) {
-    setDScore(dPlayer->getScore() + 1);
-  }
+  // The ball stays where it went out for a moment, the point is awarded
+  // when the scene moves on to the serve
+  scoredPlayer = player;
+  setScene(Scene::SCORING, SCORE_PAUSE_MS);
+}
 
-  ball->recenter();
-  uPlayer->centralize();
-  dPlayer->centralize();
-  initialRender();
-  delay(100);
+void Game::awardPoint() {
+  recorder->point(scoredPlayer);
+  sync.scorePoint(state, scoredPlayer);
+  scoredPlayer = 0;
+  uPlayer->stopMoving();
+  dPlayer->stopMoving();
+  updateScores();
+  if (!paused) initialRender();
+}
+
+void Game::setScene(Scene scene, uint32_t duration) {
+  // Leaving the scoring pause early, e.g. to open the menu, still counts the point
+  if (this->scene == Scene::SCORING) awardPoint();
+  this->scene = scene;
+  sceneStart = millis();
+  sceneDuration = duration;
+}
+
+Scene Game::getScene() {
+  return scene;
+}
+
+void Game::updateScene() {
+  if (sceneDuration == 0 || millis() - sceneStart < sceneDuration) return;
+  switch (scene) {
+    case Scene::SCORING:
+      setScene(Scene::SERVING, SERVE_PAUSE_MS);
+      break;
+    case Scene::SERVING:
+      setScene(Scene::PLAYING);
+      break;
+    case Scene::MENU_OPENING:
+      setScene(Scene::MENU);
+      getMenu()->show();
+      break;
+    case Scene::DISCOVERING:
+      setScene(Scene::MENU);
+      getMenu()->updateJoinable(getNetwork());
+      getMenu()->show();
+      break;
+    default:
+      sceneDuration = 0;
+      break;
+  }
 }
 
 void Game::togglePause() {
@@ -200,6 +419,8 @@ void Game::togglePause() {
 }
 
 void Game::setPaused(bool paused) {
+  // Menus draw straight to the panel
+  if (paused) finishFrames();
   this->paused = paused;
 }
 
@@ -208,43 +429,43 @@ bool Game::isPaused() {
 }
 
 bool Game::getIsHost() {
-  return isHost;
+  return sync.getIsHost();
 }
 
 void Game::reset() {
   Serial.println("Resetting game");
-  tickCount = 0;
-  dPlayer->reset();
-  uPlayer->reset();
-  ball->recenter();
+  sync.resetMatch(state);
+  recorder->keyframe(state, sync);
+  dPlayer->stopMoving();
+  uPlayer->stopMoving();
+  updateScores();
 }
 
 void Game::host() {
-  menu->handleHostStart();
+  getMenu()->handleHostStart();
 }
 
 void Game::refreshJoinable() {
-  network->discover();
-  network->resetDiscovered();
+  getNetwork()->discover();
+  getNetwork()->resetDiscovered();
   graphics->showMessage("Join Game", "Searching for games...");
-  delay(500);
-  std::vector<uint8_t*> discovered = network->getDiscovered();
-  menu->updateJoinable(discovered);
-  graphics->showMenu(menu);
+  // Responses are collected by Network::poll() until the scene expires
+  getMenu()->clearControls();
+  setScene(Scene::DISCOVERING, DISCOVERY_MS);
 }
 
 void Game::initJoinable() {
-  network->init();
+  getNetwork()->init();
   refreshJoinable();
 }
 
-void Game::join(uint8_t* mac) {
+void Game::join(uint8_t* mac, uint32_t seed) {
   setPeer(mac);
-  initMultiplayer();
+  initMultiplayer(false, seed);
 }
 
 void Game::setPeer(uint8_t* mac) {
-  network->setPeer(mac);
+  getNetwork()->setPeer(mac);
   memcpy(peerMac, mac, 6);
 }
 
@@ -252,71 +473,69 @@ uint8_t* Game::getPeer() {
   return peerMac;
 }
 
-void Game::initMultiplayer() {
+void Game::initMultiplayer(bool isHost, uint32_t seed) {
   Serial.println("Initializing multiplayer");
-  network->setMultiplayerHandlers();
+  sync.reset(isHost);
+  // xorshift never leaves 0
+  state.rng = seed ? seed : 1;
+  getNetwork()->setMultiplayerHandlers();
   Serial.println("Multiplayer handlers set");
   isMultiplayer = true;
   reset();
   Serial.println("Multiplayer initialized");
-  menu->close();
+  getMenu()->close();
   setPaused(false);
 }
 
 void Game::cancelMultiplayer() {
-  network->deinit();
-}
-
-RemoteTick* Game::getRemoteTick(bool scoredPlayer) {
-  RemoteTick* tick = new RemoteTick();
-  tick->tickCount = tickCount;
-  tick->scored = scoredPlayer;
-  tick->playerPos = dPlayer->getPaddle()->getPos();
-  tick->ballX = ball->getX();
-  tick->ballY = ball->getY();
-  tick->ballSpeedX = ball->getSpeedX();
-  tick->ballSpeedY = ball->getSpeedY();
-  return tick;
+  // Wi-Fi and ESP-NOW stay up for the next attempt
+  getNetwork()->stop();
 }
 
-void Game::syncGame(RemoteTick* remoteTick) {
-  if (remoteTick->tickCount <= lastRemoteTick) {
-    Serial.printf("Delayed tick: %d\n", remoteTick->tickCount);
-    return;
-  } else  {
-    lastRemoteTick = remoteTick->tickCount;
-  }
-  if (remoteTick->tickCount != tickCount - 1) {
-    return;
-  }
-  if (isHost) {
-    return;
+SyncResult Game::syncGame(const RemoteTick& remoteTick) {
+  const BallState before = state.ball;
+  SyncResult result = sync.apply(state, remoteTick);
+  if (!result.fresh) {
+    logEvent<LOG_TICK_DELAYED>(remoteTick.tickCount);
+    return result;
   }
-  int targetX = WINDOW_WIDTH - remoteTick->ballX;
-  int targetY = WINDOW_HEIGHT - remoteTick->ballY;
-  int targetSpeedX = -remoteTick->ballSpeedX;
-  int targetSpeedY = -remoteTick->ballSpeedY;
-  if (ball->getX() != targetX) {
-    Serial.printf("Ball X out of sync. Local: %d | Target: %d\n", ball->getX(), targetX);
-    ball->setX(targetX);
+  if (result.corrections) {
+    ballCorrections.add();
+    logEvent<LOG_BALL_POSITION>(before.x, before.y, state.ball.x, state.ball.y);
+    logEvent<LOG_BALL_SPEED>(before.xSpeed, before.ySpeed, state.ball.xSpeed, state.ball.ySpeed);
   }
-  if (ball->getY() != targetY) {
-    Serial.printf("Ball Y out of sync. Local: %d | Target: %d\n", ball->getY(), targetY);
-    ball->setY(targetY);
-  }
-  if (ball->getSpeedX() != targetSpeedX) {
-    Serial.printf("Ball Speed X out of sync. Local: %d | Target: %d\n", ball->getSpeedX(), targetSpeedX);
-    ball->setSpeedX(targetSpeedX);
-  }
-  if (ball->getSpeedY() != targetSpeedY) {
-    Serial.printf("Ball Speed Y out of sync. Local: %d | Target: %d\n", ball->getSpeedY(), targetSpeedY);
-    ball->setSpeedY(targetSpeedY);
-  }
-  initialRender();
+  return result;
 }
 
-void Field::render() {
-  for (int i = 0; i < WINDOW_WIDTH; i += 8) {
-    Game::tft.fillRect(i, WINDOW_HEIGHT / 2, 4, 2, WHITE);
+int Game::paintField(void* context, TFT_eSPI& canvas, Rect clip) {
+  Game* game = static_cast<Game*>(context);
+  return game->field->render(canvas, clip);
+}
+
+int Game::paintUScore(void* context, TFT_eSPI& canvas, Rect clip) {
+  Game* game = static_cast<Game*>(context);
+  return game->renderScore(canvas, Side::UP, clip);
+}
+
+int Game::paintDScore(void* context, TFT_eSPI& canvas, Rect clip) {
+  Game* game = static_cast<Game*>(context);
+  return game->renderScore(canvas, Side::DOWN, clip);
+}
+
+int Field::render(TFT_eSPI& canvas, Rect clip) {
+  // Dashes are 4px wide every 8px, so only the ones under the clip are drawn
+  int pixels = 0;
+  int first = max(clip.x, 0) / 8 * 8;
+  int last = min(clip.x + clip.w, WINDOW_WIDTH);
+  for (int i = first; i < last; i += 8) {
+    Rect restored = Compositor::intersection({i, Board::centerY, 4, 2}, clip);
+    if (restored.w <= 0 || restored.h <= 0) continue;
+    canvas.fillRect(restored.x, restored.y, restored.w, restored.h, WHITE);
+    pixels += restored.w * restored.h;
   }
+  return pixels;
+}
+
+Rect Field::getBounds() {
+  return {0, Board::centerY, WINDOW_WIDTH, 2};
 }
@@ -1,12 +1,34 @@
 #pragma once
 
 #include <TFT_eSPI.h>
-#include <OneButton.h>
 #include "ball.h"
+#include "compositor.h"
+#include "controls.h"
+#include "display.h"
+#include "draw_list.h"
+#include "fixed.h"
+#include "glyphs.h"
+#include "latency.h"
 #include "macros.h"
 #include "menu.h"
 #include "network.h"
 #include "paddle.h"
+#include "replay.h"
+#include "simulation.h"
+#include "sync.h"
+#include "task_shim.h"
+
+// How long each timed scene lasts before the loop moves on
+#define SCORE_PAUSE_MS 1000
+#define SERVE_PAUSE_MS 100
+#define MENU_OPEN_DELAY_MS 500
+#define DISCOVERY_MS 500
+
+// The render task runs on the core the loop doesn't, above the trace log and
+// metrics tasks but below the Wi-Fi task
+#define RENDER_CORE 0
+#define RENDER_PRIORITY 2
+#define RENDER_STACK 4096
 
 class Ball;
 class Graphics;
@@ -19,71 +41,121 @@ enum class Side {
   DOWN,
 };
 
+// What the main loop is currently doing. Timed scenes advance on their own
+// once their duration has passed, so nothing ever has to wait in place.
+enum class Scene {
+  PLAYING,
+  SCORING,
+  SERVING,
+  MENU_OPENING,
+  MENU,
+  DISCOVERING,
+  CONNECTING,
+};
+
+// Called by the render task after every frame it drew
+typedef void (*FrameListener)(void* context);
+
 class Field {
 public:
-  void render();
+  int render(TFT_eSPI& canvas, Rect clip);
+  Rect getBounds();
 };
 
-typedef struct RemoteTick {
-  int tickCount;
-  bool scored;
-  int playerPos;
-  int ballX;
-  int ballY;
-  int ballSpeedX;
-  int ballSpeedY;
-} RemoteTick;
-
 class Game {
 public:
-  static TFT_eSPI tft;
-  static Game* instance;
+  static Display tft;
 
   Game();
   Menu* getMenu();
+  void poll();
   void tick();
+  // Submits this tick's frame to the render task
   void render();
   void initialRender();
-  void setControls(OneButton* lButton, OneButton* rButton);
+  // From then on frames are drawn by the render task, on the other core
+  void startRendering();
+  // Returns once the render task is done with the panel, pending DMA
+  // transfers included, so it can be drawn to or read back directly
+  void finishFrames();
+  void setFrameListener(FrameListener listener, void* context);
+  void setControls(Controls* controls);
   static void handleOpenMenu(void *context);
-  OneButton* getLButton();
-  OneButton* getRButton();
+  Controls* getControls();
   Graphics* getGraphics();
   Network* getNetwork();
-  void renderScore();
+  Compositor* getCompositor();
+  GameState& getState();
+  ReplayRecorder* getRecorder();
+  LatencyTracer* getTracer();
+  int renderScore(TFT_eSPI& canvas, Side side, Rect clip);
   void setDScore(int score);
   void setUScore(int score);
   void score(int player);
   void togglePause();
   void setPaused(bool paused);
   bool isPaused();
+  void setScene(Scene scene, uint32_t duration = 0);
+  Scene getScene();
   bool getIsHost();
   void reset();
   // Multiplayer
   void host();
   void refreshJoinable();
   void initJoinable();
-  void join(uint8_t* mac);
+  void join(uint8_t* mac, uint32_t seed);
   void setPeer(uint8_t* mac);
   uint8_t* getPeer();
-  void initMultiplayer();
+  // Both boards start from the seed the host sent with its accept
+  void initMultiplayer(bool isHost, uint32_t seed);
   void cancelMultiplayer();
-  RemoteTick* getRemoteTick(bool scored);
-  void syncGame(RemoteTick* remoteTick);
+  // Returns how far the remote paddle moves this tick
+  SyncResult syncGame(const RemoteTick& remoteTick);
+  static int paintField(void* context, TFT_eSPI& canvas, Rect clip);
+  static int paintUScore(void* context, TFT_eSPI& canvas, Rect clip);
+  static int paintDScore(void* context, TFT_eSPI& canvas, Rect clip);
+  static void renderTask(void* context);
 private:
-  int tickCount;
+  GameState state;
   bool paused;
+  Scene scene;
+  uint32_t sceneStart, sceneDuration;
+  int scoredPlayer;
   bool isMultiplayer;
-  int lastRemoteTick;
-  bool isHost;
+  TickSync sync;
+  ReplayRecorder* recorder;
+  LatencyTracer* tracer;
+  // The press whose move is waiting to be drawn, and the last one sent
+  uint16_t drawnTrace, sentTrace;
   Network* network;
   Menu* menu;
   Ball* ball;
   Field* field;
   Graphics* graphics;
-  OneButton* lButton;
-  OneButton* rButton;
+  // Scores last put on the draw list
+  int32_t drawnScores[PADDLE_COUNT];
+  DrawList drawList;
+  TaskSignal drawSignal;
+  bool rendering;
+  FrameListener frameListener;
+  void* frameContext;
+  // Only used by the render task once it started
+  Compositor* compositor;
+  int uScoreLayer, dScoreLayer;
+  ScoreGlyphs uScore, dScore;
+  Controls* controls;
   Player* uPlayer;
   Player* dPlayer;
+  Paddle* uPaddle;
+  Paddle* dPaddle;
   uint8_t peerMac[6];
+
+  void draw();
+  void drawSubmitted();
+  void drawFrame(const DrawFrame& frame);
+  void showScore(PaddleSlot slot, int score);
+  void updateScene();
+  void awardPoint();
+  void updateScores();
+  Rect getScoreBounds(Side side);
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "glyphs.h"
+#include "glyph_atlas.h"
+
+static_assert(ATLAS_HEIGHT == GLYPH_HEIGHT && ATLAS_MAX_ADVANCE <= GLYPH_WIDTH, "The atlas doesn't fit the glyph cell");
+
+// Where drawString() lays out a line before pushing it
+static uint16_t textPixels[WINDOW_WIDTH * GLYPH_HEIGHT];
+
+uint16_t ScoreGlyphs::digits[10][GLYPH_WIDTH * GLYPH_HEIGHT];
+
+static int glyphIndex(char c) {
+  int code = (uint8_t) c - ATLAS_FIRST;
+  return code >= 0 && code < ATLAS_RANGE ? atlasIndex[code] : ATLAS_MISSING;
+}
+
+static uint16_t toPanelOrder(uint16_t color) {
+  return color >> 8 | color << 8;
+}
+
+int GlyphAtlas::advance(char c) {
+  return atlasAdvances[glyphIndex(c)];
+}
+
+int GlyphAtlas::textWidth(std::string_view text) {
+  int width = 0;
+  for (char c : text) width += advance(c);
+  return width;
+}
+
+void GlyphAtlas::rasterize(char c, uint16_t* pixels, int stride, uint16_t color, uint16_t bgColor) {
+  int glyph = glyphIndex(c);
+  const uint8_t* columns = atlasColumns[glyph];
+  color = toPanelOrder(color);
+  bgColor = toPanelOrder(bgColor);
+  for (int row = 0; row < GLYPH_HEIGHT; row++) {
+    uint16_t* line = pixels + row * stride;
+    for (int column = 0; column < atlasAdvances[glyph]; column++) {
+      bool set = column < ATLAS_COLUMNS && columns[column] >> row & 1;
+      line[column] = set ? color : bgColor;
+    }
+  }
+}
+
+void GlyphAtlas::drawString(Display& display, std::string_view text, int x, int y, uint16_t color, uint16_t bgColor) {
+  int left = max(x, 0);
+  int right = min(x + textWidth(text), WINDOW_WIDTH);
+  if (right <= left) return;
+  int width = right - left;
+
+  uint16_t cell[GLYPH_WIDTH * GLYPH_HEIGHT];
+  int cellX = x;
+  for (char c : text) {
+    int glyphWidth = advance(c);
+    if (cellX + glyphWidth > left && cellX < right) {
+      rasterize(c, cell, glyphWidth, color, bgColor);
+      // Only the columns on screen are copied
+      int from = max(left - cellX, 0);
+      int to = min(right - cellX, glyphWidth);
+      for (int row = 0; row < GLYPH_HEIGHT; row++) {
+        memcpy(&textPixels[row * width + cellX + from - left], &cell[row * glyphWidth + from], (to - from) * sizeof(uint16_t));
+      }
+    }
+    cellX += glyphWidth;
+  }
+  display.pushImage(left, y, width, GLYPH_HEIGHT, textPixels);
+}
+
+ScoreGlyphs::ScoreGlyphs():
+    score(-1),
+    length(0) {}
+
+void ScoreGlyphs::rasterize() {
+  for (int digit = 0; digit < 10; digit++) {
+    GlyphAtlas::rasterize('0' + digit, digits[digit], GLYPH_WIDTH, WHITE, BLACK);
+  }
+}
+
+bool ScoreGlyphs::setScore(int score) {
+  if (score == this->score) return false;
+  this->score = score;
+
+  int value = constrain(score, 0, 9999);
+  uint8_t reversed[MAX_SCORE_DIGITS];
+  length = 0;
+  do {
+    reversed[length++] = value % 10;
+    value /= 10;
+  } while (value > 0 && length < MAX_SCORE_DIGITS);
+  for (int i = 0; i < length; i++) text[i] = reversed[length - 1 - i];
+
+  // Lay the digit cells side by side, row by row
+  int width = getWidth();
+  for (int i = 0; i < length; i++) {
+    const uint16_t* digit = digits[text[i]];
+    for (int row = 0; row < GLYPH_HEIGHT; row++) {
+      memcpy(&pixels[row * width + i * GLYPH_WIDTH], &digit[row * GLYPH_WIDTH], GLYPH_WIDTH * sizeof(uint16_t));
+    }
+  }
+  return true;
+}
+
+int ScoreGlyphs::getWidth() {
+  return length * GLYPH_WIDTH;
+}
+
+int ScoreGlyphs::getHeight() {
+  return GLYPH_HEIGHT;
+}
+
+uint16_t* ScoreGlyphs::getPixels() {
+  return pixels;
+}
+
+int ScoreGlyphs::getLength() {
+  return length;
+}
+
+uint16_t* ScoreGlyphs::getDigitPixels(int index) {
+  return digits[text[index]];
+}
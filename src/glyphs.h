@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string_view>
+#include "display.h"
+#include "macros.h"
+
+// Cell size of a glyph in the atlas
+#define GLYPH_WIDTH 6
+#define GLYPH_HEIGHT 8
+#define MAX_SCORE_DIGITS 4
+
+// Text drawn from the glyph atlas generated at build time by
+// scripts/glyph_atlas.py. It only holds the characters the firmware shows,
+// anything else is drawn as '?'. Pixels are in panel byte order.
+class GlyphAtlas {
+public:
+  static int advance(char c);
+  static int textWidth(std::string_view text);
+  // One glyph cell, row by row, stride pixels apart
+  static void rasterize(char c, uint16_t* pixels, int stride, uint16_t color, uint16_t bgColor);
+  // The whole string goes out in a single address window, cropped to the screen
+  static void drawString(Display& display, std::string_view text, int x, int y, uint16_t color, uint16_t bgColor);
+};
+
+// Score bitmap built from digits rasterized once at boot. The bitmap is kept
+// in panel byte order, so it can be pushed in a single address window.
+class ScoreGlyphs {
+public:
+  ScoreGlyphs();
+  static void rasterize();
+  bool setScore(int score);
+  int getWidth();
+  int getHeight();
+  uint16_t* getPixels();
+  int getLength();
+  uint16_t* getDigitPixels(int index);
+private:
+  static uint16_t digits[10][GLYPH_WIDTH * GLYPH_HEIGHT];
+  uint16_t pixels[MAX_SCORE_DIGITS * GLYPH_WIDTH * GLYPH_HEIGHT];
+  uint8_t text[MAX_SCORE_DIGITS];
+  int score;
+  int length;
+};
@@ -1,86 +1,182 @@
 #include "graphics.h"
 
 void Graphics::drawSelectedBox(int index, const char* text, int topMargin) {
-    uint16_t fontHeight = Game::tft.fontHeight();
+    const int fontHeight = GLYPH_HEIGHT;
     int y = topMargin + index * fontHeight * 2 + MENU_MARGIN;
     Game::tft.fillRect(MENU_MARGIN, y, WINDOW_WIDTH - MENU_MARGIN * 2, fontHeight * 2, bgColor);
-    Game::tft.setTextColor(fgColor, bgColor);
-    Game::tft.drawString(text, MENU_MARGIN * 2, y + fontHeight / 2);
+    GlyphAtlas::drawString(Game::tft, text, MENU_MARGIN * 2, y + fontHeight / 2, fgColor, bgColor);
     Game::tft.drawRect(MENU_MARGIN, y, WINDOW_WIDTH - MENU_MARGIN * 2, fontHeight * 2, selectedColor);
 }
 
 void Graphics::drawClearBox(int index, const char *text, int topMargin) {
-    uint16_t fontHeight = Game::tft.fontHeight();
+    const int fontHeight = GLYPH_HEIGHT;
     int y = topMargin + index * fontHeight * 2 + MENU_MARGIN;
     Game::tft.fillRect(MENU_MARGIN, y, WINDOW_WIDTH - MENU_MARGIN * 2, fontHeight * 2, bgColor);
-    Game::tft.setTextColor(fgColor, bgColor);
-    Game::tft.drawString(text, MENU_MARGIN * 2, y + fontHeight / 2);
+    GlyphAtlas::drawString(Game::tft, text, MENU_MARGIN * 2, y + fontHeight / 2, fgColor, bgColor);
 }
 
 void Graphics::showMenu(Menu* menu) {
     SubMenu* subMenu = menu->getCurrentMenu();
-    int fontHeight = Game::tft.fontHeight();
-    int titleHeight = MENU_MARGIN + fontHeight * getLineCount(subMenu->getTitle().c_str());
-    int textHeight = MENU_MARGIN + titleHeight + fontHeight * getLineCount(subMenu->getText().c_str());
-    Game::tft.fillScreen(bgColor);
-    drawTitle(subMenu->getTitle().c_str());
-    drawMessage(subMenu->getText().c_str());
-    std::vector<MenuOption> options = subMenu->getOptions();
-    for (int i = 0; i < options.size(); i++) {
-        if (i == menu->getSelected()) {
-            drawSelectedBox(i, options[i].getText().c_str(), textHeight);
-        } else {
-            drawClearBox(i, options[i].getText().c_str(), textHeight);
-        }
+    MenuLayout& menuLayout = getLayout(subMenu);
+    uint32_t title = TextLayout::hash(subMenu->getTitle());
+    uint32_t text = TextLayout::hash(subMenu->getText());
+    scrollTo(menu->getSelected(), menuLayout);
+    int optionsY = menuLayout.optionsTop + MENU_MARGIN;
+    int visible = min(subMenu->getOptionCount(), menuLayout.visibleOptions);
+    int optionsBottom = optionsY + visible * menuLayout.optionHeight;
+
+    bool titleChanged = !menuShown || title != shownTitle;
+    bool textChanged = !menuShown || text != shownText;
+    if (!menuShown) {
+        Game::tft.fillScreen(bgColor);
+    } else {
+        if (titleChanged) clearRows(MENU_MARGIN, MENU_MARGIN + GLYPH_HEIGHT);
+        if (textChanged) clearRows(shownTextY, shownTextBottom);
+        // Option rows that the new menu doesn't cover anymore
+        clearRows(shownOptionsY, min(shownOptionsBottom, optionsY));
+        clearRows(max(shownOptionsY, optionsBottom), shownOptionsBottom);
     }
+
+    if (titleChanged) drawTitle(subMenu->getTitle());
+    if (textChanged) drawMessage(subMenu->getText());
+    drawOptions(menu, menuLayout);
+
+    menuShown = true;
+    shownTitle = title;
+    shownText = text;
+    shownTextY = menuLayout.textY;
+    shownTextBottom = menuLayout.textBottom;
+    shownOptionsY = optionsY;
+    shownOptionsBottom = optionsBottom;
 }
 
 void Graphics::renderMenuOption(Menu* menu) {
     int currentSelected = menu->getSelected();
     int previousSelected = menu->getPreviousSelected();
     SubMenu* subMenu = menu->getCurrentMenu();
-    int fontHeight = Game::tft.fontHeight();
-    int titleHeight = MENU_MARGIN + fontHeight * getLineCount(subMenu->getTitle().c_str());
-    int textHeight = MENU_MARGIN + titleHeight + fontHeight * getLineCount(subMenu->getText().c_str());
-    Game::tft.setTextColor(fgColor, bgColor);
-    drawClearBox(previousSelected, subMenu->getOptions()[previousSelected].getText().c_str(), textHeight);
-    drawSelectedBox(currentSelected, subMenu->getOptions()[currentSelected].getText().c_str(), textHeight);
+    MenuLayout& menuLayout = getLayout(subMenu);
+    int firstVisible = menuLayout.firstVisible;
+    scrollTo(currentSelected, menuLayout);
+    if (menuLayout.firstVisible != firstVisible) {
+        drawOptions(menu, menuLayout);
+        return;
+    }
+
+    const MenuOption* options = subMenu->getOptions();
+    drawClearBox(previousSelected - firstVisible, options[previousSelected].getText(), menuLayout.optionsTop);
+    drawSelectedBox(currentSelected - firstVisible, options[currentSelected].getText(), menuLayout.optionsTop);
+}
+
+void Graphics::resetScreen() {
+    menuShown = false;
+}
+
+MenuLayout& Graphics::getLayout(SubMenu* subMenu) {
+    MenuLayout& menuLayout = subMenu->getLayout();
+    if (menuLayout.valid) return menuLayout;
+
+    const int fontHeight = GLYPH_HEIGHT;
+    int titleHeight = MENU_MARGIN + fontHeight * getLineCount(subMenu->getTitle());
+    menuLayout.textY = MENU_MARGIN + fontHeight * 2;
+    menuLayout.textBottom = menuLayout.textY + wrapText(subMenu->getText()).count * fontHeight * 2;
+    menuLayout.optionsTop = MENU_MARGIN + titleHeight + fontHeight * getLineCount(subMenu->getText());
+    menuLayout.optionHeight = fontHeight * 2;
+    menuLayout.visibleOptions = max(1, (WINDOW_HEIGHT - menuLayout.optionsTop - MENU_MARGIN * 2) / menuLayout.optionHeight);
+    menuLayout.firstVisible = 0;
+    menuLayout.valid = true;
+    return menuLayout;
+}
+
+void Graphics::drawOptions(Menu* menu, MenuLayout& menuLayout) {
+    SubMenu* subMenu = menu->getCurrentMenu();
+    const MenuOption* options = subMenu->getOptions();
+    int last = min(subMenu->getOptionCount(), menuLayout.firstVisible + menuLayout.visibleOptions);
+    for (int i = menuLayout.firstVisible; i < last; i++) {
+        if (i == menu->getSelected()) {
+            drawSelectedBox(i - menuLayout.firstVisible, options[i].getText(), menuLayout.optionsTop);
+        } else {
+            drawClearBox(i - menuLayout.firstVisible, options[i].getText(), menuLayout.optionsTop);
+        }
+    }
+}
+
+void Graphics::scrollTo(int selected, MenuLayout& menuLayout) {
+    if (selected < menuLayout.firstVisible) {
+        menuLayout.firstVisible = selected;
+    } else if (selected >= menuLayout.firstVisible + menuLayout.visibleOptions) {
+        menuLayout.firstVisible = selected - menuLayout.visibleOptions + 1;
+    }
+}
+
+void Graphics::clearRows(int y0, int y1) {
+    if (y1 > y0) Game::tft.fillRect(0, y0, WINDOW_WIDTH, y1 - y0, bgColor);
 }
 
 void Graphics::showMessage(const char *title, const char *message) {
+    resetScreen();
     Game::tft.fillScreen(bgColor);
-    int titleHeight = MENU_MARGIN + Game::tft.fontHeight() * getLineCount(title);
+    int titleHeight = MENU_MARGIN + GLYPH_HEIGHT * getLineCount(title);
     drawTitle(title);
     drawMessage(message, titleHeight);
 }
 
 int Graphics::getLineCount(const char *message) {
-    return wrapText(message).size() + 1;
+    return wrapText(message).count + 1;
 }
 
 void Graphics::drawTitle(const char *title) {
-    uint16_t fontHeight = Game::tft.fontHeight();
-    int textWidth = Game::tft.textWidth(title);
-    int x = (WINDOW_WIDTH - textWidth) / 2;
-    Game::tft.setTextColor(selectedColor, bgColor);
-    Game::tft.drawString(title, x, MENU_MARGIN);
+    int x = (WINDOW_WIDTH - GlyphAtlas::textWidth(title)) / 2;
+    GlyphAtlas::drawString(Game::tft, title, x, MENU_MARGIN, selectedColor, bgColor);
 }
 
 void Graphics::drawMessage(const char *message, int titleHeight) {
-    std::vector<std::string> wrappedText = wrapText(message);
-    uint16_t fontHeight = Game::tft.fontHeight();
+    const TextLines& wrappedText = wrapText(message);
+    const int fontHeight = GLYPH_HEIGHT;
     if (titleHeight == 0) {
         titleHeight = fontHeight * 2;
     }
     int y = MENU_MARGIN + titleHeight;
-    Game::tft.setTextColor(fgColor, bgColor);
-    for (int i = 0; i < wrappedText.size(); i++) {
-        Game::tft.drawString(wrappedText[i].c_str(), MENU_MARGIN, y);
+    std::string_view text(message);
+    for (int i = 0; i < wrappedText.count; i++) {
+        LineSpan span = wrappedText.lines[i];
+        GlyphAtlas::drawString(Game::tft, text.substr(span.start, span.length), MENU_MARGIN, y, fgColor, bgColor);
         y += fontHeight * 2;
     }
 }
 
-std::vector<std::string> Graphics::wrapText(const char *text) {
+const TextLines& Graphics::wrapText(const char *text) {
+    return layout.wrap(text, WINDOW_WIDTH - MENU_MARGIN * 2);
+}
+
+#ifdef LAYOUT_BENCHMARK
+// Times the word wrapping of every menu text with the previous vector based
+// implementation against the cached layout
+void Graphics::benchmarkLayout() {
+    const char* texts[] = {
+        "Select an option",
+        "Select a game to join",
+        "An unknown player wants to join your game",
+        "Waiting for player to join. Your MAC address is:\n\n 00:00:00:00:00:00",
+        "Waiting for response. Your MAC is: 00:00:00:00:00:00"
+    };
+    const int runs = 100;
+    for (const char* text : texts) {
+        unsigned long start = micros();
+        size_t legacyLines = 0;
+        for (int i = 0; i < runs; i++) legacyLines = legacyWrapText(text).size();
+        unsigned long legacy = micros() - start;
+
+        start = micros();
+        size_t lines = 0;
+        for (int i = 0; i < runs; i++) lines = wrapText(text).count;
+        unsigned long cached = micros() - start;
+
+        Serial.printf("Layout \"%.20s\": legacy %lu us (%u lines), cached %lu us (%u lines) per %d runs\n",
+                      text, legacy, legacyLines, cached, lines, runs);
+    }
+}
+
+std::vector<std::string> Graphics::legacyWrapText(const char *text) {
     std::vector<std::string> wrappedText;
     std::vector<std::string> words;
     std::string word = "";
@@ -106,7 +202,7 @@ std::vector<std::string> Graphics::wrapText(const char *text) {
     while (words.size() > 0) {
         std::string line = words[0];
         words.erase(words.begin());
-        while (words.size() > 0 && Game::tft.textWidth((line + " " + words[0]).c_str()) < WINDOW_WIDTH - MENU_MARGIN * 2) {
+        while (words.size() > 0 && GlyphAtlas::textWidth(line + " " + words[0]) < WINDOW_WIDTH - MENU_MARGIN * 2) {
             if (words[0] == "\n") {
                 words.erase(words.begin());
                 break;
@@ -118,4 +214,5 @@ std::vector<std::string> Graphics::wrapText(const char *text) {
     }
 
     return wrappedText;
-}
\ No newline at end of file
+}
+#endif
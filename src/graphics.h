@@ -3,8 +3,10 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include "glyphs.h"
 #include "macros.h"
 #include "menu.h"
+#include "text_layout.h"
 
 class Menu;
 class SubMenu;
@@ -14,16 +16,33 @@ public:
     Graphics():
         fgColor(WHITE),
         bgColor(BLACK),
-        selectedColor(LIGHT_BLUE) {}
+        selectedColor(LIGHT_BLUE),
+        menuShown(false) {}
     void drawSelectedBox(int index, const char *string, int topMargin = 0);
     void drawClearBox(int index, const char *string, int topMargin = 0);
     void showMenu(Menu* menu);
     void renderMenuOption(Menu* menu);
     void showMessage(const char *title, const char *message);
     int getLineCount(const char *message);
+    void resetScreen();
+#ifdef LAYOUT_BENCHMARK
+    void benchmarkLayout();
+#endif
 private:
     uint32_t fgColor, bgColor, selectedColor;
+    TextLayout layout;
+    // What the last menu left on screen, so the next one only clears what changes
+    bool menuShown;
+    uint32_t shownTitle, shownText;
+    int shownTextY, shownTextBottom, shownOptionsY, shownOptionsBottom;
+    MenuLayout& getLayout(SubMenu* subMenu);
+    void drawOptions(Menu* menu, MenuLayout& menuLayout);
+    void scrollTo(int selected, MenuLayout& menuLayout);
+    void clearRows(int y0, int y1);
     void drawTitle(const char *title);
     void drawMessage(const char *message, int topMargin = 0);
-    std::vector<std::string> wrapText(const char *text);
+    const TextLines& wrapText(const char *text);
+#ifdef LAYOUT_BENCHMARK
+    std::vector<std::string> legacyWrapText(const char *text);
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "heap_tracker.h"
+
+// In front of every block, keeping what follows it aligned for any type
+typedef struct alignas(alignof(std::max_align_t)) BlockHeader {
+  uint32_t size;
+  HeapTag tag;
+} BlockHeader;
+
+typedef struct TagStats {
+  std::atomic<int32_t> liveBytes;
+  std::atomic<int32_t> liveBlocks;
+  std::atomic<int32_t> peakBytes;
+  std::atomic<uint32_t> allocations;
+  // Lowest live size since the last sample
+  std::atomic<int32_t> floor;
+  // Only touched by sampleHeap()
+  int32_t lastFloor;
+  int rises;
+} TagStats;
+
+static const char* tagNames[HEAP_TAG_COUNT] = {
+  "other", "game", "render", "network", "menu", "replay",
+};
+
+static TagStats stats[HEAP_TAG_COUNT];
+static thread_local HeapTag currentTag = HEAP_OTHER;
+
+HeapScope::HeapScope(HeapTag tag): previous(currentTag) {
+  currentTag = tag;
+}
+
+HeapScope::~HeapScope() {
+  currentTag = previous;
+}
+
+static void* allocate(size_t size) {
+  BlockHeader* header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+  if (!header) return nullptr;
+  header->size = size;
+  header->tag = currentTag;
+  TagStats& tag = stats[header->tag];
+  int32_t live = tag.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  tag.liveBlocks.fetch_add(1, std::memory_order_relaxed);
+  tag.allocations.fetch_add(1, std::memory_order_relaxed);
+  int32_t peak = tag.peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !tag.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+  return header + 1;
+}
+
+static void release(void* pointer) {
+  if (!pointer) return;
+  BlockHeader* header = static_cast<BlockHeader*>(pointer) - 1;
+  TagStats& tag = stats[header->tag];
+  int32_t live = tag.liveBytes.fetch_sub(header->size, std::memory_order_relaxed) - header->size;
+  tag.liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+  int32_t floor = tag.floor.load(std::memory_order_relaxed);
+  while (live < floor && !tag.floor.compare_exchange_weak(floor, live, std::memory_order_relaxed)) {}
+  free(header);
+}
+
+static void* allocateOrThrow(size_t size) {
+  void* pointer = allocate(size);
+  if (pointer) return pointer;
+#if __cpp_exceptions
+  throw std::bad_alloc();
+#else
+  abort();
+#endif
+}
+
+void* operator new(size_t size) {
+  return allocateOrThrow(size);
+}
+
+void* operator new[](size_t size) {
+  return allocateOrThrow(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  release(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  release(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+  release(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+  release(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+  release(pointer);
+}
+
+const char* heapTagName(HeapTag tag) {
+  return tagNames[tag];
+}
+
+HeapUsage heapUsage(HeapTag tag) {
+  const TagStats& tagStats = stats[tag];
+  return {
+    tagStats.liveBytes.load(std::memory_order_relaxed),
+    tagStats.liveBlocks.load(std::memory_order_relaxed),
+    tagStats.peakBytes.load(std::memory_order_relaxed),
+    tagStats.allocations.load(std::memory_order_relaxed),
+    tagStats.rises >= HEAP_SUSPECT_RISES,
+  };
+}
+
+int32_t heapLiveBytes() {
+  int32_t total = 0;
+  for (const TagStats& tag : stats) total += tag.liveBytes.load(std::memory_order_relaxed);
+  return total;
+}
+
+int32_t heapLiveBlocks() {
+  int32_t total = 0;
+  for (const TagStats& tag : stats) total += tag.liveBlocks.load(std::memory_order_relaxed);
+  return total;
+}
+
+uint32_t heapAllocations() {
+  uint32_t total = 0;
+  for (const TagStats& tag : stats) total += tag.allocations.load(std::memory_order_relaxed);
+  return total;
+}
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#include "metrics.h"
+
+static Gauge liveGauges[HEAP_TAG_COUNT] = {
+  {"heap.other"}, {"heap.game"}, {"heap.render"}, {"heap.network"}, {"heap.menu"}, {"heap.replay"},
+};
+// Bit per tag
+static Gauge suspectGauge("heap.suspects");
+static Gauge largestBlock("sys.largest_block");
+#endif
+
+void sampleHeap() {
+  int32_t suspects = 0;
+  for (int i = 0; i < HEAP_TAG_COUNT; i++) {
+    TagStats& tag = stats[i];
+    // Transient allocations come and go, what a leak leaves behind is a
+    // floor that never comes back down
+    int32_t floor = tag.floor.exchange(tag.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    if (floor < tag.lastFloor) tag.rises = 0;
+    else if (floor > tag.lastFloor) tag.rises++;
+    tag.lastFloor = floor;
+    if (heapUsage((HeapTag) i).suspect) suspects |= 1 << i;
+#ifdef ARDUINO
+    liveGauges[i].set(tag.liveBytes.load(std::memory_order_relaxed));
+#endif
+  }
+#ifdef ARDUINO
+  suspectGauge.set(suspects);
+  largestBlock.set(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+#endif
+}
+
+#ifdef ARDUINO
+void reportHeap(Print& out) {
+  out.printf("Heap (bytes)     live  blocks    peak  allocs\n");
+  for (int i = 0; i < HEAP_TAG_COUNT; i++) {
+    HeapUsage usage = heapUsage((HeapTag) i);
+    out.printf("%-10s %10d %7d %7d %7u%s\n", tagNames[i], usage.liveBytes, usage.liveBlocks,
+        usage.peakBytes, usage.allocations, usage.suspect ? "  leak suspect" : "");
+  }
+  size_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  // Share of the free heap that can't be had in one block
+  out.printf("Free %u, minimum %u, largest block %u, fragmentation %u%%\n", freeBytes,
+      heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT), largest, freeBytes ? 100 - largest * 100 / freeBytes : 0);
+}
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+// A tag whose lowest live size rose on this many samples, without ever
+// falling back in between, is reported as a leak suspect
+#define HEAP_SUSPECT_RISES 8
+
+// Who an allocation belongs to, by the HeapScope it was made in
+enum HeapTag : uint8_t {
+  HEAP_OTHER,
+  HEAP_GAME,
+  HEAP_RENDER,
+  HEAP_NETWORK,
+  HEAP_MENU,
+  HEAP_REPLAY,
+  HEAP_TAG_COUNT
+};
+
+typedef struct HeapUsage {
+  int32_t liveBytes;
+  int32_t liveBlocks;
+  int32_t peakBytes;
+  uint32_t allocations;
+  bool suspect;
+} HeapUsage;
+
+// Every operator new is counted against the tag of the innermost scope on
+// the calling thread, and operator delete credits it back to the same tag.
+// malloc() and heap_caps_malloc() are not seen, see reportHeap() for the
+// heap as a whole.
+class HeapScope {
+public:
+  HeapScope(HeapTag tag);
+  HeapScope(const HeapScope&) = delete;
+  ~HeapScope();
+private:
+  HeapTag previous;
+};
+
+const char* heapTagName(HeapTag tag);
+HeapUsage heapUsage(HeapTag tag);
+// Totals over every tag
+int32_t heapLiveBytes();
+int32_t heapLiveBlocks();
+uint32_t heapAllocations();
+// Called at a steady rate, updates the leak suspects and the heap gauges
+void sampleHeap();
+
+#ifdef ARDUINO
+#include <Arduino.h>
+// Per tag usage, then free heap, largest free block and fragmentation
+void reportHeap(Print& out);
+#endif
@@ -0,0 +1,127 @@
+#include "latency.h"
+
+static const char* pathNames[PATH_COUNT] = {
+  "input", "step", "draw", "local", "link", "remote draw", "remote",
+};
+
+LatencyTracer::LatencyTracer():
+    traces{},
+    nextId(1),
+    histograms{},
+    remoteId(0),
+    echoedId(0),
+    remoteArrival(0),
+    remoteDrawnAt(0),
+    echoHold(0),
+    echoDraw(0),
+    remoteApplied(false) {}
+
+uint16_t LatencyTracer::begin(uint32_t edgeTime, uint32_t acceptedAt) {
+  uint16_t id = nextId++;
+  if (nextId == 0) nextId = 1;
+  Trace& trace = traces[id % MAX_TRACES];
+  trace = {};
+  trace.id = id;
+  mark(id, STAGE_EDGE, edgeTime);
+  mark(id, STAGE_ACCEPTED, acceptedAt);
+  return id;
+}
+
+LatencyTracer::Trace* LatencyTracer::find(uint16_t id) {
+  Trace& trace = traces[id % MAX_TRACES];
+  return id && trace.id == id ? &trace : nullptr;
+}
+
+void LatencyTracer::mark(uint16_t id, LatencyStage stage, uint32_t time) {
+  Trace* trace = find(id);
+  if (!trace || trace->stages & (1 << stage)) return;
+  trace->times[stage] = time;
+  trace->stages |= 1 << stage;
+  if (stage != STAGE_DRAWN) return;
+
+  const uint32_t* times = trace->times;
+  record(PATH_INPUT, times[STAGE_ACCEPTED] - times[STAGE_EDGE]);
+  record(PATH_STEP, times[STAGE_STEPPED] - times[STAGE_ACCEPTED]);
+  record(PATH_DRAW, times[STAGE_DRAWN] - times[STAGE_STEPPED]);
+  record(PATH_LOCAL, times[STAGE_DRAWN] - times[STAGE_EDGE]);
+}
+
+void LatencyTracer::received(const RemoteTick& tick, uint32_t arrival) {
+  if (tick.trace && tick.trace != remoteId) {
+    remoteId = tick.trace;
+    remoteArrival = arrival;
+    remoteDrawnAt = 0;
+    remoteApplied = true;
+  }
+
+  Trace* trace = find(tick.echoTrace);
+  if (!trace || trace->echoed || !(trace->stages & (1 << STAGE_SENT))) return;
+  trace->echoed = true;
+  // The peer's hold is taken out of the round trip, what's left is the link
+  // both ways
+  uint32_t roundTrip = arrival - trace->times[STAGE_SENT];
+  uint32_t hold = tick.echoHold * ECHO_UNIT_US;
+  uint32_t link = roundTrip > hold ? (roundTrip - hold) / 2 : 0;
+  uint32_t draw = tick.echoDraw * ECHO_UNIT_US;
+  record(PATH_LINK, link);
+  record(PATH_REMOTE_DRAW, draw);
+  record(PATH_REMOTE, trace->times[STAGE_SENT] - trace->times[STAGE_EDGE] + link + draw);
+}
+
+void LatencyTracer::remoteDrawn(uint32_t time) {
+  if (!remoteApplied) return;
+  remoteApplied = false;
+  remoteDrawnAt = time;
+}
+
+void LatencyTracer::fillEcho(RemoteTick& tick, uint32_t now) {
+  if (!remoteId || !remoteDrawnAt) return;
+  // Measured once, then repeated on every tick so a lost one doesn't lose it
+  if (echoedId != remoteId) {
+    echoedId = remoteId;
+    echoHold = min((now - remoteArrival) / ECHO_UNIT_US, (uint32_t) UINT16_MAX);
+    echoDraw = min((remoteDrawnAt - remoteArrival) / ECHO_UNIT_US, (uint32_t) UINT16_MAX);
+  }
+  tick.echoTrace = echoedId;
+  tick.echoHold = echoHold;
+  tick.echoDraw = echoDraw;
+}
+
+// Four buckets per power of two, so each is within 25% of its values
+int LatencyTracer::bucket(uint32_t us) {
+  if (us < 4) return us;
+  int exponent = 31 - __builtin_clz(us);
+  int index = (exponent - 1) * 4 + ((us >> (exponent - 2)) & 3);
+  return min(index, LATENCY_BUCKETS - 1);
+}
+
+uint32_t LatencyTracer::bucketStart(int bucket) {
+  if (bucket < 4) return bucket;
+  return (uint32_t) (4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+void LatencyTracer::record(LatencyPath path, uint32_t us) {
+  LatencyHistogram& histogram = histograms[path];
+  histogram.buckets[bucket(us)]++;
+  histogram.count++;
+  histogram.max = max(histogram.max, us);
+}
+
+uint32_t LatencyTracer::percentile(const LatencyHistogram& histogram, uint32_t perMille) {
+  uint32_t target = (uint64_t) histogram.count * perMille / 1000;
+  uint32_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += histogram.buckets[i];
+    if (seen > target) return bucketStart(i);
+  }
+  return histogram.max;
+}
+
+void LatencyTracer::report(Print& out) {
+  out.printf("Latency (us)   count    p50    p90    p99    max\n");
+  for (int i = 0; i < PATH_COUNT; i++) {
+    const LatencyHistogram& histogram = histograms[i];
+    out.printf("%-12s %7u %6u %6u %6u %6u\n", pathNames[i], histogram.count,
+        percentile(histogram, 500), percentile(histogram, 900), percentile(histogram, 990), histogram.max);
+  }
+}
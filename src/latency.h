@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+#include "sync.h"
+
+// Presses followed at once, older ones are dropped if they never complete
+#define MAX_TRACES 16
+// Four buckets per power of two of microseconds, up to 2^24 us
+#define LATENCY_BUCKETS 96
+// Remote timings travel in these units
+#define ECHO_UNIT_US 10
+
+enum LatencyStage : uint8_t {
+  // Edge captured by the interrupt
+  STAGE_EDGE,
+  // Debounced and handed to the player
+  STAGE_ACCEPTED,
+  // First tick that moved the paddle
+  STAGE_STEPPED,
+  // Frame with the moved paddle drawn
+  STAGE_DRAWN,
+  // Tick with the move sent to the peer
+  STAGE_SENT,
+  STAGE_COUNT
+};
+
+enum LatencyPath : uint8_t {
+  PATH_INPUT, // Edge to accepted
+  PATH_STEP, // Accepted to stepped
+  PATH_DRAW, // Stepped to drawn
+  PATH_LOCAL, // Edge to drawn on this screen
+  PATH_LINK, // Sent to received by the peer, half the round trip
+  PATH_REMOTE_DRAW, // Received to drawn by the peer
+  PATH_REMOTE, // Edge to drawn on the peer's screen
+  PATH_COUNT
+};
+
+typedef struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+} LatencyHistogram;
+
+// Follows paddle presses from the button edge to the moved paddle on both
+// screens. A trace id travels in RemoteTick, and the peer echoes back how
+// long it held and drew the move, so the remote path is measured with each
+// board's own clock only.
+class LatencyTracer {
+public:
+  LatencyTracer();
+  // Returns the new trace id, never 0
+  uint16_t begin(uint32_t edgeTime, uint32_t acceptedAt);
+  void mark(uint16_t id, LatencyStage stage, uint32_t time);
+  // A tick from the peer, which may carry its own trace or an echo of ours
+  void received(const RemoteTick& tick, uint32_t arrival);
+  // After a frame was drawn with the latest received tick applied
+  void remoteDrawn(uint32_t time);
+  // Adds the echo of the last drawn peer trace to an outgoing tick
+  void fillEcho(RemoteTick& tick, uint32_t now);
+  void report(Print& out);
+  static uint32_t percentile(const LatencyHistogram& histogram, uint32_t perMille);
+private:
+  typedef struct Trace {
+    uint16_t id;
+    uint32_t times[STAGE_COUNT];
+    uint8_t stages; // Bit per stage marked
+    bool echoed;
+  } Trace;
+
+  Trace traces[MAX_TRACES];
+  uint16_t nextId;
+  LatencyHistogram histograms[PATH_COUNT];
+  // The peer's latest trace, until it has been echoed
+  uint16_t remoteId, echoedId;
+  uint32_t remoteArrival, remoteDrawnAt;
+  uint16_t echoHold, echoDraw;
+  bool remoteApplied;
+
+  Trace* find(uint16_t id);
+  void record(LatencyPath path, uint32_t us);
+  static int bucket(uint32_t us);
+  static uint32_t bucketStart(int bucket);
+};
@@ -0,0 +1,223 @@
+// Trace log decoder. Reads serial output captured from a board, or stdin
+// without arguments, and prints the plain text in it as is and every trace
+// log record as a line of text, noting where records were lost. Metrics
+// frames are skipped. A replay recording dumped with 'r' is saved to
+// replay.bin, or the file given with -r, for the replay environment, and a
+// framebuffer dumped with 'd' to frame.ppm, or the file given with -p:
+//   pio device monitor --raw | .pio/build/logdecode/program -r match.bin
+#ifndef ARDUINO
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "log_events.h"
+#include "metrics.h"
+
+static const char* formats[LOG_EVENT_COUNT] = {
+#define X(event, level, format) format,
+  LOG_EVENTS(X)
+#undef X
+};
+
+static const char levelNames[] = "-EWIDV";
+
+static std::string formatRecord(const LogRecord& record) {
+  const char* format = formats[record.event];
+  std::string text;
+  int arg = 0;
+  char buffer[32];
+  for (const char* at = format; *at; at++) {
+    if (*at != '%') {
+      text += *at;
+      continue;
+    }
+    if (at[1] == '%') {
+      text += '%';
+      at++;
+      continue;
+    }
+    if (at[1] == 'M') {
+      uint32_t high = arg < LOG_ARGS ? record.args[arg++] : 0;
+      uint32_t low = arg < LOG_ARGS ? record.args[arg++] : 0;
+      snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",
+          high >> 24, (high >> 16) & 0xFF, (high >> 8) & 0xFF, high & 0xFF, (low >> 8) & 0xFF, low & 0xFF);
+      text += buffer;
+      at++;
+      continue;
+    }
+    // A printf conversion of a single argument, flags and width included
+    const char* end = at + 1;
+    while (*end && !strchr("diuxXc", *end)) end++;
+    if (!*end) break;
+    std::string spec(at, end + 1);
+    snprintf(buffer, sizeof(buffer), spec.c_str(), arg < LOG_ARGS ? record.args[arg++] : 0);
+    text += buffer;
+    at = end;
+  }
+  return text;
+}
+
+class Decoder {
+public:
+  Decoder(const char* replayPath, const char* imagePath):
+      state(TEXT), filled(0), skip(0), hasSequence(false), lastSequence(0), records(0), lost(0),
+      replay{"Replay dump", replayPath, nullptr, 0}, image{"Image", imagePath, nullptr, 0}, current(nullptr) {}
+
+  void feed(uint8_t byte) {
+    switch (state) {
+      case TEXT:
+        if (byte == LOG_SYNC_0) state = SYNC;
+        else putchar(byte);
+        break;
+      case SYNC:
+        if (byte == LOG_SYNC_1) {
+          state = RECORD;
+          filled = 0;
+        } else if (byte == METRICS_SYNC_1) {
+          state = METRICS_HEADER;
+          filled = 0;
+        } else {
+          // Not a record after all, serial text is plain ASCII so this is
+          // just noise
+          state = TEXT;
+          feed(byte);
+        }
+        break;
+      case RECORD:
+        frame[filled++] = byte;
+        if (filled == sizeof(LogRecord)) {
+          state = TEXT;
+          decode();
+        }
+        break;
+      case METRICS_HEADER:
+        frame[filled++] = byte;
+        if (filled == 3) {
+          // Type, then the payload length, then the payload and its checksum
+          skip = (frame[1] | frame[2] << 8) + 1;
+          current = frame[0] == METRICS_REPLAY ? &replay : frame[0] == METRICS_PPM ? &image : nullptr;
+          state = current ? CHUNK : METRICS;
+          payload.clear();
+        }
+        break;
+      case METRICS:
+        if (--skip == 0) state = TEXT;
+        break;
+      case CHUNK:
+        payload.push_back(byte);
+        if (--skip == 0) {
+          state = TEXT;
+          save(*current);
+        }
+        break;
+    }
+  }
+
+  void report() {
+    for (Dump* open : {&replay, &image}) {
+      if (!open->file) continue;
+      fprintf(stderr, "%s cut off after %u bytes\n", open->name, open->length);
+      fclose(open->file);
+    }
+    fprintf(stderr, "%u records, %u lost\n", records, lost);
+  }
+private:
+  enum State { TEXT, SYNC, RECORD, METRICS_HEADER, METRICS, CHUNK };
+
+  // A replay recording or an image being saved as its frames come in
+  typedef struct Dump {
+    const char* name;
+    const char* path;
+    FILE* file;
+    uint32_t length;
+  } Dump;
+
+  State state;
+  uint8_t frame[sizeof(LogRecord)];
+  size_t filled, skip;
+  bool hasSequence;
+  uint16_t lastSequence;
+  uint32_t records, lost;
+  Dump replay, image;
+  // The dump the current frame belongs to, and its payload and checksum
+  Dump* current;
+  std::vector<uint8_t> payload;
+
+  void save(Dump& dump) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i + 1 < payload.size(); i++) sum += payload[i];
+    if (payload.size() < 5 || sum != payload.back()) {
+      printf("[          ] ! Corrupt %s frame\n", dump.name);
+      return;
+    }
+    uint32_t offset = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+    size_t length = payload.size() - 5;
+    // A dump starts over at offset 0, anything else has to follow on
+    if (offset == 0 && length > 0) {
+      if (dump.file) fclose(dump.file);
+      dump.file = fopen(dump.path, "wb");
+      dump.length = 0;
+      if (!dump.file) fprintf(stderr, "Can't open %s\n", dump.path);
+    }
+    if (!dump.file) return;
+    if (offset != dump.length) {
+      printf("[          ] ! %s lost bytes %u to %u, dropped\n", dump.name, dump.length, offset);
+      fclose(dump.file);
+      dump.file = nullptr;
+      return;
+    }
+    if (length == 0) {
+      printf("[          ] %s of %u bytes saved to %s\n", dump.name, dump.length, dump.path);
+      fclose(dump.file);
+      dump.file = nullptr;
+      return;
+    }
+    fwrite(&payload[4], 1, length, dump.file);
+    dump.length += length;
+  }
+
+  void decode() {
+    LogRecord record;
+    memcpy(&record, frame, sizeof(LogRecord));
+    if (record.event >= LOG_EVENT_COUNT) {
+      printf("[          ] ? Unknown event %u\n", record.event);
+      return;
+    }
+    if (hasSequence) {
+      uint16_t gap = record.sequence - lastSequence - 1;
+      if (gap) printf("[          ] ! %u records lost\n", gap);
+      lost += gap;
+    }
+    hasSequence = true;
+    lastSequence = record.sequence;
+    records++;
+    printf("[%10.6f] %c %s\n", record.time / 1e6, levelNames[logLevels[record.event]], formatRecord(record).c_str());
+  }
+};
+
+int main(int argc, char** argv) {
+  const char* replayPath = "replay.bin";
+  const char* imagePath = "frame.ppm";
+  int first = 1;
+  while (first + 1 < argc && (strcmp(argv[first], "-r") == 0 || strcmp(argv[first], "-p") == 0)) {
+    if (argv[first][1] == 'r') replayPath = argv[first + 1];
+    else imagePath = argv[first + 1];
+    first += 2;
+  }
+  Decoder decoder(replayPath, imagePath);
+  for (int i = first; i < argc || i == first; i++) {
+    FILE* file = argc > first ? fopen(argv[i], "rb") : stdin;
+    if (!file) {
+      fprintf(stderr, "Can't open %s\n", argv[i]);
+      return 1;
+    }
+    int byte;
+    while ((byte = fgetc(file)) != EOF) decoder.feed(byte);
+    if (file != stdin) fclose(file);
+  }
+  decoder.report();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#define LOG_NONE 0
+#define LOG_ERROR 1
+#define LOG_WARN 2
+#define LOG_INFO 3
+#define LOG_DEBUG 4
+#define LOG_VERBOSE 5
+
+// Every trace log event, with its level and the format the decoder prints it
+// with. Events only ever get appended, records name them by position. A %M
+// takes two arguments, a MAC packed by macHigh() and macLow().
+#define LOG_EVENTS(X) \
+  X(LOG_DROPPED, LOG_WARN, "Dropped %u log records") \
+  X(LOG_SCORED, LOG_INFO, "Scored player: %d") \
+  X(LOG_REMOTE_SCORED, LOG_DEBUG, "Remote should have scored") \
+  X(LOG_TICK_MISSED, LOG_DEBUG, "Failed to receive remote tick") \
+  X(LOG_TICK_DELAYED, LOG_DEBUG, "Delayed tick: %d") \
+  X(LOG_BALL_POSITION, LOG_INFO, "Ball out of sync. Local: %d, %d | Target: %d, %d") \
+  X(LOG_BALL_SPEED, LOG_INFO, "Ball speed out of sync. Local: %d, %d | Target: %d, %d") \
+  X(LOG_ESPNOW_FAILED, LOG_ERROR, "Failed to initialize ESP-NOW: %x") \
+  X(LOG_NOT_INITIALIZED, LOG_ERROR, "Network not initialized") \
+  X(LOG_PEER_NOT_SET, LOG_WARN, "Peer MAC not set") \
+  X(LOG_MUTEX_FAILED, LOG_ERROR, "Failed to take mutex") \
+  X(LOG_DISCOVERY_SENT, LOG_INFO, "Discovery message sent") \
+  X(LOG_DISCOVERY_FAILED, LOG_WARN, "Failed to send discovery message: %d") \
+  X(LOG_TICK_SEND_FAILED, LOG_WARN, "Failed to send remote tick: %d") \
+  X(LOG_INVALID_TICK, LOG_WARN, "Invalid tick size: %d") \
+  X(LOG_JOIN_SENT, LOG_INFO, "Join message sent to %M") \
+  X(LOG_JOIN_FAILED, LOG_WARN, "Failed to send join message: %d") \
+  X(LOG_ACCEPT_SENT, LOG_INFO, "Join accepted") \
+  X(LOG_ACCEPT_FAILED, LOG_WARN, "Failed to accept join: %d") \
+  X(LOG_DECLINE_SENT, LOG_INFO, "Declined join from %M") \
+  X(LOG_DECLINE_FAILED, LOG_WARN, "Failed to decline join: %d") \
+  X(LOG_MULTIPLAYER_HANDLERS, LOG_INFO, "Multiplayer handlers set, peer %M exists: %d") \
+  X(LOG_DISCOVERY_RECEIVED, LOG_INFO, "Received discovery from %M") \
+  X(LOG_JOIN_RECEIVED, LOG_INFO, "Received join request from %M") \
+  X(LOG_UNKNOWN_MESSAGE, LOG_WARN, "Unknown message from %M, %d bytes") \
+  X(LOG_DISCOVERY_RESPONSE, LOG_INFO, "Received response from %M") \
+  X(LOG_JOIN_ACKNOWLEDGED, LOG_INFO, "Acknowledge join request from %M") \
+  X(LOG_ACCEPT_RECEIVED, LOG_INFO, "Received join accept from %M") \
+  X(LOG_DECLINE_RECEIVED, LOG_INFO, "Received join decline from %M") \
+  X(LOG_RADIO_DROPPED, LOG_WARN, "Radio queue full, dropped %u messages")
+
+enum LogEvent : uint16_t {
+#define X(event, level, format) event,
+  LOG_EVENTS(X)
+#undef X
+  LOG_EVENT_COUNT
+};
+
+constexpr uint8_t logLevels[LOG_EVENT_COUNT] = {
+#define X(event, level, format) level,
+  LOG_EVENTS(X)
+#undef X
+};
+
+#define LOG_ARGS 4
+// Every record goes out behind these, so the decoder can find records among
+// plain text on the same port
+#define LOG_SYNC_0 0xA5
+#define LOG_SYNC_1 0x5A
+
+// 24 bytes, sent as is, little endian
+typedef struct LogRecord {
+  uint32_t time; // micros()
+  uint16_t event;
+  // Counts every record written, so the decoder can tell where some were lost
+  uint16_t sequence;
+  int32_t args[LOG_ARGS];
+} LogRecord;
@@ -1,19 +1,19 @@
 #pragma once
 
+#include "board.h"
+
 #define BLACK 0x0000
 #define WHITE 0xFFFF
 #define GREY  0x5AEB
 #define LIGHT_BLUE  0x2356D9
 #define BLUE  0x001F
 #define RED   0xF800
-#define WINDOW_WIDTH 135
-#define WINDOW_HEIGHT 240
+#define WINDOW_WIDTH Board::width
+#define WINDOW_HEIGHT Board::height
+
+#define UPS 30 // Updates per second
+#define INTERVAL (1000 / UPS)
 
 #define LINE_GAP 5
 #define MENU_MARGIN 10
-#define OPTION_HEIGHT 25
-
-#define MENU_MAIN "main"
-#define MENU_MULTIPLAYER "multiplayer"
-#define MENU_MULTIPLAYER_JOIN "join"
-#define MENU_MULTIPLAYER_JOIN_REQUEST "join_request"
\ No newline at end of file
+#define OPTION_HEIGHT 25
\ No newline at end of file
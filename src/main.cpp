@@ -1,43 +1,202 @@
 #include <Arduino.h>
 #include <TFT_eSPI.h>
 #include <SPI.h>
-#include <OneButton.h>
+#include <LittleFS.h>
+#include <algorithm>
+#include <vector>
+#include "boot_profile.h"
+#include "controls.h"
 #include "game.h"
+#include "heap_tracker.h"
 #include "macros.h"
+#include "metrics.h"
+#include "trace_log.h"
 
 #define LBUTTON 0
 #define RBUTTON 35
 
-#define UPS 30 // Updates per second
-#define INTERVAL 1000 / UPS
+#define REPLAY_PATH "/replay.bin"
 
 unsigned long previousMillis = 0;
 
+static const uint32_t slackBounds[] = {0, 5000, 10000, 15000, 20000, 25000, 30000};
+
+// Time left in the tick interval after ticking and handing the frame to the
+// render task, 0 is an overrun
+static Histogram loopSlack("sys.loop_slack_us", slackBounds);
+
 Game* game;
-OneButton lButton, rButton;
+Controls controls;
+
+#ifdef RECORDING_DISPLAY
+// Prints render cost once per second, called by the render task
+void reportFrame(void* context) {
+  static FrameStats second = {0, 0};
+  static uint32_t restored = 0;
+  FrameStats frame = Game::tft.endFrame();
+  second.pixels += frame.pixels;
+  second.windows += frame.windows;
+  restored += game->getCompositor()->getRestoredPixels();
+  if (Game::tft.getFrameCount() % UPS == 0) {
+    Serial.printf("Render: %u px (%u restored), %u windows, ~%u us SPI per second\n",
+        second.pixels, restored, second.windows, RecordingDisplay::estimateSpiMicros(second));
+    second = {0, 0};
+    restored = 0;
+  }
+}
+#endif
+
+// A replay recording or an image as it's written, cut into frames of its
+// type. Each goes out in a single write, so the trace log and metrics tasks
+// sending to the port meanwhile can only land between frames
+typedef struct SerialDump {
+  MetricsFrame type;
+  uint8_t chunk[METRICS_CHUNK_SIZE];
+  size_t filled;
+  uint32_t offset;
+} SerialDump;
+
+static void sendChunk(SerialDump& dump) {
+  static uint8_t frame[METRICS_CHUNK_SIZE + 16];
+  size_t length = encodeChunk(frame, sizeof(frame), dump.type, dump.offset, dump.chunk, dump.filled);
+  Serial.write(frame, length);
+  dump.offset += dump.filled;
+  dump.filled = 0;
+}
+
+void writeDump(void* context, const uint8_t* data, size_t length) {
+  SerialDump* dump = static_cast<SerialDump*>(context);
+  while (length > 0) {
+    size_t part = std::min(length, sizeof(dump->chunk) - dump->filled);
+    memcpy(dump->chunk + dump->filled, data, part);
+    dump->filled += part;
+    data += part;
+    length -= part;
+    if (dump->filled == sizeof(dump->chunk)) sendChunk(*dump);
+  }
+}
+
+// Sends what's left, then the empty frame that ends the dump
+static void finishDump(SerialDump& dump) {
+  if (dump.filled) sendChunk(dump);
+  sendChunk(dump);
+}
+
+void writeFile(void* context, const uint8_t* data, size_t length) {
+  static_cast<File*>(context)->write(data, length);
+}
+
+void appendBuffer(void* context, const uint8_t* data, size_t length) {
+  std::vector<uint8_t>* buffer = static_cast<std::vector<uint8_t>*>(context);
+  buffer->insert(buffer->end(), data, data + length);
+}
+
+// Commands received over serial:
+// r: dumps the replay recording, framed for logdecode to save
+// f: saves the replay recording to flash
+// v: replays the recording on the board and checks it
+// l: prints the input latency distributions
+// h: prints heap usage by subsystem
+// b: prints how long each boot phase took
+// d: dumps the framebuffer as a PPM image, with RECORDING_DISPLAY, framed
+//    for logdecode to save
+void handleSerial() {
+  if (!Serial.available()) return;
+  ReplayRecorder* recorder = game->getRecorder();
+  switch (Serial.read()) {
+    case 'r': {
+      SerialDump dump = {METRICS_REPLAY};
+      recorder->flush(writeDump, &dump);
+      finishDump(dump);
+      break;
+    }
+    case 'f': {
+      if (!LittleFS.begin(true)) {
+        Serial.println("Failed to mount flash");
+        break;
+      }
+      File file = LittleFS.open(REPLAY_PATH, "w");
+      size_t length = recorder->flush(writeFile, &file);
+      file.close();
+      Serial.printf("Saved %u bytes to %s\n", length, REPLAY_PATH);
+      break;
+    }
+    case 'v': {
+      std::vector<uint8_t> buffer;
+      recorder->flush(appendBuffer, &buffer);
+      ReplayResult result = runReplay(buffer.data(), buffer.size());
+      Serial.printf("Replay %s: %u ticks, %u/%u hashes mismatched, first at tick %u\n",
+          result.valid ? "valid" : "invalid", result.ticks, result.mismatches, result.hashesChecked, result.firstMismatch);
+      break;
+    }
+    case 'l':
+      game->getTracer()->report(Serial);
+      break;
+    case 'h':
+      reportHeap(Serial);
+      break;
+    case 'b':
+      bootProfile.report(Serial);
+      break;
+#ifdef RECORDING_DISPLAY
+    case 'd': {
+      // The render task would be drawing into the framebuffer as it's read
+      game->finishFrames();
+      SerialDump dump = {METRICS_PPM};
+      Game::tft.dumpPPM(writeDump, &dump);
+      finishDump(dump);
+      break;
+    }
+#endif
+  }
+}
 
 void setup(void) {
+  bootProfile.mark("core");
   Serial.begin(115200);
+  traceLog.begin();
+  startMetricsExport();
   Serial.println("Starting function");
-  randomSeed(analogRead(0)*analogRead(1));
-  Serial.println("Random seed generated");
+  bootProfile.mark("serial");
+  // The hardware generator, analogRead() on the button pin was slower and
+  // left it in analog mode until controls.begin()
+  randomSeed(esp_random());
+  bootProfile.mark("seed");
 
   Game::tft.init();
-  Game::tft.setRotation(0);
+  Game::tft.setRotation(Board::rotation);
   Game::tft.fillScreen(BLACK);
-  
-  lButton.setup(LBUTTON, INPUT_PULLUP, true);
-  rButton.setup(RBUTTON, INPUT_PULLDOWN, true);
+  bootProfile.mark("display");
+
+  controls.begin(LBUTTON, INPUT_PULLUP, RBUTTON, INPUT_PULLDOWN);
+  bootProfile.mark("controls");
 
   game = new Game();
-  game->setControls(&lButton, &rButton);
+  game->setControls(&controls);
+#ifdef BUFFERED_RENDERING
+  game->getCompositor()->enableBuffering();
+#endif
+#ifdef RECORDING_DISPLAY
+  game->setFrameListener(reportFrame, nullptr);
+#endif
+  game->startRendering();
+  bootProfile.mark("playable");
+  bootProfile.report(Serial);
+#ifdef LAYOUT_BENCHMARK
+  game->getGraphics()->benchmarkLayout();
+#endif
 }
 
 void loop() {
+  game->poll();
+  handleSerial();
   unsigned long currentMillis = millis();
   if (currentMillis - previousMillis >= INTERVAL) {
     previousMillis = currentMillis;
+    uint32_t start = micros();
     game->tick();
     game->render();
+    uint32_t elapsed = micros() - start;
+    loopSlack.record(elapsed < INTERVAL * 1000 ? INTERVAL * 1000 - elapsed : 0);
   }
 }
@@ -1,75 +1,113 @@
+#include <iterator>
 #include "game.h"
 #include "macros.h"
 #include "menu.h"
+#include "metrics.h"
 
-void noop(void *_) {}
+static const uint32_t lobbyBounds[] = {10000, 25000, 50000, 100000, 250000, 500000, 1000000};
 
-std::string MenuOption::getText() {
+// From picking Host or Join to its screen being up
+static Histogram lobbyTime("menu.lobby_us", lobbyBounds);
+
+const char* MenuOption::getText() const {
   return text;
 }
 
-MenuHandler MenuOption::getHandler() {
+MenuHandler MenuOption::getHandler() const {
   return handler;
 }
 
-std::string SubMenu::getTitle() {
+const char* SubMenu::getTitle() {
   return title;
 }
 
-std::string SubMenu::getText() {
+const char* SubMenu::getText() {
   return text;
 }
 
-void SubMenu::setText(std::string text) {
+void SubMenu::setText(const char* text) {
   this->text = text;
+  layout.valid = false;
 }
 
-std::vector<MenuOption> SubMenu::getOptions() {
+const MenuOption* SubMenu::getOptions() {
   return options;
 }
 
-void SubMenu::setOptions(std::vector<MenuOption> options) {
-  this->options = options;
+int SubMenu::getOptionCount() {
+  return optionCount;
 }
 
+void SubMenu::setOptions(const MenuOption* options, int optionCount) {
+  this->options = options;
+  this->optionCount = optionCount;
+  layout.valid = false;
+}
+
+MenuLayout& SubMenu::getLayout() {
+  return layout;
+}
+
+typedef struct MenuDefinition {
+  const char* title;
+  const char* text;
+  const MenuOption* options;
+  int optionCount;
+} MenuDefinition;
+
+static constexpr MenuOption mainOptions[] = {
+  MenuOption("Resume", Menu::resumeOption),
+  MenuOption("New Game", Menu::newGameOption),
+  MenuOption("Multiplayer", Menu::multiplayerOption),
+  MenuOption("Help", Menu::helpOption)
+};
+
+static constexpr MenuOption multiplayerOptions[] = {
+  MenuOption("Host", Menu::hostOption),
+  MenuOption("Join", Menu::listJoinOption)
+};
+
+static constexpr MenuOption joinOptionsTemplate[] = {
+  MenuOption("Refresh", Menu::refreshJoinOption)
+};
+
+static constexpr MenuOption joinRequestOptions[] = {
+  MenuOption("Accept", Menu::acceptJoinOption),
+  MenuOption("Decline", Menu::declineJoinOption)
+};
+
+// Indexed by MenuId
+static constexpr MenuDefinition definitions[MENU_COUNT] = {
+  {"Main Menu", "Select an option", mainOptions, std::size(mainOptions)},
+  {"Multiplayer", "Select an option", multiplayerOptions, std::size(multiplayerOptions)},
+  {"Join Game", "Select a game to join", joinOptionsTemplate, std::size(joinOptionsTemplate)},
+  {"Join Request", "An unknown player wants to join your game", joinRequestOptions, std::size(joinRequestOptions)}
+};
+
 Menu::Menu(Game* game):
     game(game),
-    selectedOption(0) {
+    previousSelected(0),
+    selectedOption(0),
+    currentMenu(MENU_MAIN),
+    menuDepth(0),
+    controls(nullptr) {
   graphics = game->getGraphics();
-  std::vector<MenuOption> mainMenu = {
-    MenuOption("Resume", Menu::resumeOption),
-    MenuOption("New Game", Menu::newGameOption),
-    MenuOption("Multiplayer", Menu::multiplayerOption),
-    MenuOption("Help", Menu::helpOption)
-  };
-
-  std::vector<MenuOption> multiplayerMenu = {
-    MenuOption("Host", Menu::hostOption),
-    MenuOption("Join", Menu::listJoinOption)
-  };
-
-  std::vector<MenuOption> joinMenu = {
-    MenuOption("Refresh", Menu::refreshJoinOption)
-  };
-
-  std::vector<MenuOption> joinRequest = {
-    MenuOption("Accept", Menu::acceptJoinOption),
-    MenuOption("Decline", Menu::declineJoinOption)
-  };
-
-  menus.emplace(MENU_MAIN, SubMenu("Main Menu", "Select an option", mainMenu));
-  menus.emplace(MENU_MULTIPLAYER, SubMenu("Multiplayer", "Select an option", multiplayerMenu));
-  menus.emplace(MENU_MULTIPLAYER_JOIN, SubMenu("Join Game", "Select a game to join", joinMenu));
-  menus.emplace(MENU_MULTIPLAYER_JOIN_REQUEST, SubMenu("Join Request", "An unknown player wants to join your game", joinRequest));
-}
-
-void Menu::open() {
+  for (int i = 0; i < MENU_COUNT; i++) {
+    const MenuDefinition& definition = definitions[i];
+    menus[i] = SubMenu(definition.title, definition.text, definition.options, definition.optionCount);
+  }
+}
+
+void Menu::open(MenuId id) {
   game->setPaused(true);
-  lButton->reset();
-  rButton->reset();
-  lButton->tick();
-  rButton->tick();
-  delay(500);
+  setCurrentMenu(id, false);
+  // The buttons are still held from opening the menu, so the menu only takes
+  // over the controls once the opening scene has passed
+  clearControls();
+  game->setScene(Scene::MENU_OPENING, MENU_OPEN_DELAY_MS);
+}
+
+void Menu::show() {
   graphics->showMenu(this);
   Serial.println("Acquiring controls");
   acquireControls();
@@ -77,8 +115,9 @@ void Menu::open() {
 
 void Menu::close() {
   Game::tft.fillScreen(BLACK);
-  Game::tft.setTextColor(WHITE, BLACK);
+  graphics->resetScreen();
   releaseControls();
+  game->setScene(Scene::PLAYING);
   game->initialRender();
   game->setPaused(false);
 }
@@ -92,13 +131,12 @@ int Menu::getPreviousSelected() {
 }
 
 void Menu::stackMenu() {
-  menuStack.push_back(currentMenu);
+  if (menuDepth < MAX_MENU_DEPTH) menuStack[menuDepth++] = currentMenu;
 }
 
 void Menu::unstackMenu() {
-  if (menuStack.size() > 0) {
-    currentMenu = menuStack.back();
-    menuStack.pop_back();
+  if (menuDepth > 0) {
+    currentMenu = menuStack[--menuDepth];
     acquireControls();
   }
 }
@@ -108,24 +146,24 @@ Game* Menu::getGame() {
 }
 
 SubMenu* Menu::getCurrentMenu() {
-  return &menus.at(currentMenu);
+  return &menus[currentMenu];
 }
 
-SubMenu* Menu::getMenu(std::string name) {
-  return &menus.at(name);
+SubMenu* Menu::getMenu(MenuId id) {
+  return &menus[id];
 }
 
-void Menu::setCurrentMenu(std::string name) {
-  currentMenu = name;
+void Menu::setCurrentMenu(MenuId id, bool redraw) {
+  currentMenu = id;
   selectedOption = 0;
   previousSelected = 0;
-  graphics->showMenu(this);
+  if (redraw) graphics->showMenu(this);
 }
 
 void Menu::previous() {
   SubMenu* subMenu = getCurrentMenu();
   previousSelected = selectedOption;
-  selectedOption = (selectedOption + subMenu->getOptions().size() - 1) % subMenu->getOptions().size();
+  selectedOption = (selectedOption + subMenu->getOptionCount() - 1) % subMenu->getOptionCount();
   Serial.printf("Selected option: %d\n", selectedOption);
   graphics->renderMenuOption(this);
 }
@@ -133,55 +171,36 @@ void Menu::previous() {
 void Menu::next() {
   SubMenu* subMenu = getCurrentMenu();
   previousSelected = selectedOption;
-  selectedOption = (selectedOption + 1) % subMenu->getOptions().size();
+  selectedOption = (selectedOption + 1) % subMenu->getOptionCount();
   Serial.printf("Selected option: %d\n", selectedOption);
   graphics->renderMenuOption(this);
 }
 
 void Menu::select() {
   SubMenu* subMenu = getCurrentMenu();
-  MenuOption option = subMenu->getOptions()[selectedOption];
-  option.getHandler()(this);
+  MenuHandler handler = subMenu->getOptions()[selectedOption].getHandler();
+  handler(this);
 }
 
-void Menu::setControls(OneButton* lButton, OneButton* rButton) {
-  this->lButton = lButton;
-  this->rButton = rButton;
+void Menu::setControls(Controls* controls) {
+  this->controls = controls;
 }
 
 void Menu::clearControls() {
-  lButton->attachClick(noop, NULL);
-  lButton->attachLongPressStart(noop, NULL);
-  lButton->attachPress(noop, NULL);
-  lButton->attachLongPressStop(noop, NULL);
-  lButton->attachDuringLongPress(noop, NULL);
-
-  rButton->attachClick(noop, NULL);
-  rButton->attachLongPressStart(noop, NULL);
-  rButton->attachPress(noop, NULL);
-  rButton->attachLongPressStop(noop, NULL);
-  rButton->attachDuringLongPress(noop, NULL);
-
-  lButton->reset();
-  rButton->reset();
-  lButton->tick();
-  rButton->tick();
+  controls->clear();
 }
 
 void Menu::acquireControls() {
   clearControls();
-  lButton->setLongPressIntervalMs(400);
-  lButton->attachClick(Menu::handlePrevious, this);
-  lButton->attachLongPressStart(Menu::handleBack, this);
-
-  rButton->setLongPressIntervalMs(400);
-  rButton->attachClick(Menu::handleNext, this);
-  rButton->attachLongPressStart(Menu::handleSelect, this);
+  controls->attach(LEFT_BUTTON, CLICK, Menu::handlePrevious, this);
+  controls->attach(LEFT_BUTTON, LONG_PRESS, Menu::handleBack, this);
+  controls->attach(RIGHT_BUTTON, CLICK, Menu::handleNext, this);
+  controls->attach(RIGHT_BUTTON, LONG_PRESS, Menu::handleSelect, this);
 }
 
 void Menu::releaseControls() {
   clearControls();
-  game->setControls(lButton, rButton);
+  game->setControls(controls);
 }
 
 void Menu::handlePrevious(void *context) {
@@ -202,7 +221,7 @@ void Menu::handleSelect(void *context) {
 
 void Menu::handleBack(void *context) {
   Menu* menu = static_cast<Menu*>(context);
-  if (menu->menuStack.size() > 0) {
+  if (menu->menuDepth > 0) {
     menu->unstackMenu();
     menu->setCurrentMenu(menu->currentMenu);
   } else {
@@ -211,7 +230,7 @@ void Menu::handleBack(void *context) {
 }
 
 void Menu::attachBack() {
-  lButton->attachLongPressStart(Menu::handleBack, this);
+  controls->attach(LEFT_BUTTON, LONG_PRESS, Menu::handleBack, this);
 }
 
 void Menu::resumeOption(void *context) {
@@ -234,89 +253,91 @@ void Menu::multiplayerOption(void *context) {
 
 void Menu::hostOption(void *context) {
   Menu* menu = static_cast<Menu*>(context);
-  Game* game = menu->getGame();
+  uint32_t start = micros();
   menu->handleHostStart();
+  lobbyTime.record(micros() - start);
 }
 
 void Menu::listJoinOption(void *context) {
   Menu* menu = static_cast<Menu*>(context);
   Game* game = menu->getGame();
+  uint32_t start = micros();
   menu->stackMenu();
   menu->setCurrentMenu(MENU_MULTIPLAYER_JOIN);
   game->initJoinable();
-  menu->open();
+  lobbyTime.record(micros() - start);
 }
 
 void Menu::handleJoinRequestSent() {
-  Game* game = Game::instance;
-  Menu* menu = game->getMenu();
   Network* network = game->getNetwork();
 
-  String ownMac = network->getMacString();
+  uint8_t mac[MAC_LENGTH];
+  char macText[MAC_STRING_LENGTH];
+  network->getMac(mac);
+  Network::stringFromMac(mac, macText);
   char message[100];
-  snprintf(message, 100, "Waiting for response. Your MAC is: %s", ownMac.c_str());
-  menu->stackMenu();
-  menu->clearControls();
-  game->getLButton()->attachLongPressStart(Menu::handleCancel, menu);
+  snprintf(message, 100, "Waiting for response. Your MAC is: %s", macText);
+  stackMenu();
+  clearControls();
+  controls->attach(LEFT_BUTTON, LONG_PRESS, Menu::handleCancel, this);
   game->getGraphics()->showMessage("Join Request", message);
+  game->setScene(Scene::CONNECTING);
 }
 
 void Menu::handleJoinRequestReceived(uint8_t* mac) {
-  Game* game = Game::instance;
-  Menu* menu = game->getMenu();
   Network* network = game->getNetwork();
-  SubMenu* joinRequestMenu = menu->getMenu(MENU_MULTIPLAYER_JOIN_REQUEST);
+  SubMenu* joinRequestMenu = getMenu(MENU_MULTIPLAYER_JOIN_REQUEST);
 
   game->setPeer(mac);
 
-  char message[100];
-  String macStr = network->stringFromMac(mac);
-  snprintf(message, 100, "Player %s wants to join your game", macStr.c_str());
-  joinRequestMenu->setText(message);
-  menu->stackMenu();
-  menu->setCurrentMenu(MENU_MULTIPLAYER_JOIN_REQUEST);
-  menu->acquireControls();
+  char macText[MAC_STRING_LENGTH];
+  Network::stringFromMac(mac, macText);
+  snprintf(joinRequestText, MENU_TEXT_LENGTH, "Player %s wants to join your game", macText);
+  joinRequestMenu->setText(joinRequestText);
+  game->setScene(Scene::MENU);
+  stackMenu();
+  setCurrentMenu(MENU_MULTIPLAYER_JOIN_REQUEST);
+  acquireControls();
 }
 
-void Menu::handleJoinRequestAccepted() {
-  Game* game = Game::instance;
-  game->initMultiplayer();
+void Menu::handleJoinRequestAccepted(uint32_t seed) {
+  game->initMultiplayer(false, seed);
 }
 
 void Menu::handleJoinRequestDeclined() {
-  Game* game = Game::instance;
-  Menu* menu = game->getMenu();
-  menu->clearControls();
-  game->getLButton()->attachLongPressStart(Menu::handleMultiplayerCancel, menu);
+  clearControls();
+  controls->attach(LEFT_BUTTON, LONG_PRESS, Menu::handleMultiplayerCancel, this);
   game->getGraphics()->showMessage("Join Request", "Your request was declined");
 }
 
 void Menu::handleHostStart() {
-  Game* game = Game::instance;
-  Menu* menu = game->getMenu();
   Network* network = game->getNetwork();
 
   network->init();
   network->enableDiscovery();
-  uint8_t* mac = network->getMac();
-  String macStr = network->stringFromMac(mac);
+  uint8_t mac[MAC_LENGTH];
+  char macText[MAC_STRING_LENGTH];
+  network->getMac(mac);
+  Network::stringFromMac(mac, macText);
   char message[100];
-  snprintf(message, 100, "Waiting for player to join. Your MAC address is:\n\n %s", macStr.c_str());
-  menu->clearControls();
-  game->getLButton()->attachLongPressStart(Menu::handleMultiplayerCancel, menu);
+  snprintf(message, 100, "Waiting for player to join. Your MAC address is:\n\n %s", macText);
+  clearControls();
+  controls->attach(LEFT_BUTTON, LONG_PRESS, Menu::handleMultiplayerCancel, this);
   game->getGraphics()->showMessage("Host", message);
+  game->setScene(Scene::CONNECTING);
 }
 
-void Menu::updateJoinable(std::vector<uint8_t*> discovered) {
+void Menu::updateJoinable(Network* network) {
   SubMenu* joinableMenu = getMenu(MENU_MULTIPLAYER_JOIN);
-  std::vector<MenuOption> newOptions;
-  Network* network = game->getNetwork();
-  newOptions.push_back(MenuOption("Refresh", Menu::refreshJoinOption));
-  for (uint8_t* mac : discovered) {
-    String macText = network->stringFromMac(mac);
-    newOptions.push_back(MenuOption(macText.c_str(), Menu::requestJoinOption));
+  int count = 0;
+  joinOptions[count++] = joinOptionsTemplate[0];
+  int discovered = min(network->getDiscoveredCount(), MAX_JOINABLE);
+  for (int i = 0; i < discovered; i++) {
+    char* label = joinLabels[count - 1];
+    Network::stringFromMac(network->getDiscovered(i), label);
+    joinOptions[count++] = MenuOption(label, Menu::requestJoinOption);
   }
-  joinableMenu->setOptions(newOptions);
+  joinableMenu->setOptions(joinOptions, count);
 }
 
 void Menu::refreshJoinOption(void *context) {
@@ -331,9 +352,8 @@ void Menu::requestJoinOption(void *context) {
   Network* network = game->getNetwork();
 
   SubMenu* joinMenu = menu->getMenu(MENU_MULTIPLAYER_JOIN);
-  std::vector<MenuOption> options = joinMenu->getOptions();
-  String selectedMac = options[menu->getSelected()].getText().c_str();
-  uint8_t* mac = network->macFromString(selectedMac);
+  uint8_t mac[MAC_LENGTH];
+  if (!Network::macFromString(joinMenu->getOptions()[menu->getSelected()].getText(), mac)) return;
   network->requestJoin(mac);
   menu->handleJoinRequestSent();
 }
@@ -342,8 +362,10 @@ void Menu::acceptJoinOption(void *context) {
   Menu* menu = static_cast<Menu*>(context);
   Game* game = menu->getGame();
   Network* network = game->getNetwork();
-  network->acceptJoin();
-  game->initMultiplayer();
+  // Sent along with the accept, so both boards serve alike
+  uint32_t seed = random(1, INT32_MAX);
+  network->acceptJoin(seed);
+  game->initMultiplayer(true, seed);
 }
 
 void Menu::declineJoinOption(void *context) {
@@ -360,6 +382,7 @@ void Menu::handleCancel(void *context) {
   Menu* menu = static_cast<Menu*>(context);
   Game* game = menu->getGame();
   Serial.println("Cancelling");
+  game->setScene(Scene::MENU);
   menu->unstackMenu();
   menu->setCurrentMenu(menu->currentMenu);
 }
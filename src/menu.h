@@ -1,49 +1,81 @@
 #pragma once
 
-#include <string>
-#include <unordered_map>
-#include <vector>
 #include "game.h"
 #include "graphics.h"
 #include "macros.h"
+#include "network.h"
+#include "text_layout.h"
 
 class Game;
+class Network;
+
+#define MAX_MENU_DEPTH 4
+#define MAX_JOINABLE 8
+#define MENU_TEXT_LENGTH 100
 
 typedef void (*MenuHandler)(void*);
 
+enum MenuId : uint8_t {
+  MENU_MAIN,
+  MENU_MULTIPLAYER,
+  MENU_MULTIPLAYER_JOIN,
+  MENU_MULTIPLAYER_JOIN_REQUEST,
+  MENU_COUNT
+};
+
 class MenuOption {
 public:
-  MenuOption(std::string text, MenuHandler handler):
+  constexpr MenuOption():
+    text(""),
+    handler(nullptr) {}
+  constexpr MenuOption(const char* text, MenuHandler handler):
     text(text),
     handler(handler) {}
-  std::string getText();
-  MenuHandler getHandler();
+  const char* getText() const;
+  MenuHandler getHandler() const;
 private:
-  std::string text;
+  const char* text;
   MenuHandler handler;
 };
 
+// Runtime view of a menu. Titles, texts and options point into the constant
+// tables in flash, only the join menus point to buffers owned by Menu.
 class SubMenu {
 public:
-  SubMenu(std::string title, std::string text, std::vector<MenuOption> options):
+  SubMenu():
+    title(""),
+    text(""),
+    options(nullptr),
+    optionCount(0),
+    layout{false} {}
+  SubMenu(const char* title, const char* text, const MenuOption* options, int optionCount):
     title(title),
     text(text),
-    options(options) {}
-  std::string getTitle();
-  std::string getText();
-  void setText(std::string text);
-  std::vector<MenuOption> getOptions();
-  void setOptions(std::vector<MenuOption> options);
+    options(options),
+    optionCount(optionCount),
+    layout{false} {}
+  const char* getTitle();
+  const char* getText();
+  void setText(const char* text);
+  const MenuOption* getOptions();
+  int getOptionCount();
+  void setOptions(const MenuOption* options, int optionCount);
+  MenuLayout& getLayout();
 private:
-  std::string title;
-  std::string text;
-  std::vector<MenuOption> options;
+  const char* title;
+  const char* text;
+  const MenuOption* options;
+  int optionCount;
+  MenuLayout layout;
 };
 
 class Menu {
 public:
   Menu(Game* game);
-  void open();
+  // Pauses the game before anything is drawn, the menu itself is drawn by
+  // show() once the opening scene has passed
+  void open(MenuId id);
+  void show();
   void close();
   void next();
   void previous();
@@ -54,10 +86,11 @@ public:
   void unstackMenu();
   Game* getGame();
   SubMenu* getCurrentMenu();
-  SubMenu* getMenu(std::string name);
-  void setCurrentMenu(std::string name);
+  SubMenu* getMenu(MenuId id);
+  // Without redraw only the selection moves, for when show() draws it next
+  void setCurrentMenu(MenuId id, bool redraw = true);
   // Button handlers
-  void setControls(OneButton* lButton, OneButton* rButton);
+  void setControls(Controls* controls);
   void clearControls();
   static void handlePrevious(void *context);
   static void handleNext(void *context);
@@ -70,7 +103,7 @@ public:
   static void multiplayerOption(void *context);
   static void helpOption(void *context);
   // Multiplayer options
-  void updateJoinable(std::vector<uint8_t*> discovered);
+  void updateJoinable(Network* network);
   static void hostOption(void *context);
   static void listJoinOption(void *context);
   static void refreshJoinOption(void *context);
@@ -79,21 +112,24 @@ public:
   static void declineJoinOption(void *context);
   static void handleCancel(void *context);
   static void handleMultiplayerCancel(void *context);
-  static void handleJoinRequestSent();
-  static void handleJoinRequestReceived(uint8_t* mac);
-  static void handleJoinRequestAccepted();
-  static void handleJoinRequestDeclined();
-  static void handleHostStart();
+  void handleJoinRequestSent();
+  void handleJoinRequestReceived(uint8_t* mac);
+  void handleJoinRequestAccepted(uint32_t seed);
+  void handleJoinRequestDeclined();
+  void handleHostStart();
 private:
   Game* game;
   int previousSelected;
   int selectedOption;
-  std::unordered_map<std::string, SubMenu> menus;
-  std::string currentMenu;
-  std::vector<std::string> menuStack;
+  SubMenu menus[MENU_COUNT];
+  MenuId currentMenu;
+  MenuId menuStack[MAX_MENU_DEPTH];
+  int menuDepth;
+  MenuOption joinOptions[MAX_JOINABLE + 1];
+  char joinLabels[MAX_JOINABLE][MAC_STRING_LENGTH];
+  char joinRequestText[MENU_TEXT_LENGTH];
 
-  OneButton* lButton;
-  OneButton* rButton;
+  Controls* controls;
   Graphics* graphics;
 
   void acquireControls();
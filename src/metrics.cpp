@@ -0,0 +1,182 @@
+#include "metrics.h"
+
+Metric* Metric::first = nullptr;
+int Metric::count = 0;
+
+Metric::Metric(const char* name, MetricKind kind): name(name), kind(kind), next(nullptr) {
+  // Constructed during static initialization only, before anything reads
+  // the list. Appended so the order follows construction.
+  Metric** at = &first;
+  while (*at) at = &(*at)->next;
+  *at = this;
+  count++;
+}
+
+const char* Metric::getName() const {
+  return name;
+}
+
+MetricKind Metric::getKind() const {
+  return kind;
+}
+
+const Metric* Metric::getNext() const {
+  return next;
+}
+
+const Metric* Metric::getFirst() {
+  return first;
+}
+
+int Metric::getCount() {
+  return count;
+}
+
+// Appends little endian fields to a frame, and remembers if any didn't fit
+class FrameWriter {
+public:
+  FrameWriter(uint8_t* frame, size_t size, MetricsFrame type): frame(frame), size(size), length(0), fits(true) {
+    put8(METRICS_SYNC_0);
+    put8(METRICS_SYNC_1);
+    put8(type);
+    // Payload length, filled in by finish()
+    put16(0);
+  }
+
+  void put8(uint8_t value) {
+    if (length >= size) {
+      fits = false;
+      return;
+    }
+    frame[length++] = value;
+  }
+
+  void put16(uint16_t value) {
+    put8(value);
+    put8(value >> 8);
+  }
+
+  void put32(uint32_t value) {
+    put16(value);
+    put16(value >> 16);
+  }
+
+  size_t finish() {
+    size_t payload = length - 5;
+    uint8_t sum = 0;
+    for (size_t i = 5; i < length; i++) sum += frame[i];
+    put8(sum);
+    if (!fits || payload > UINT16_MAX) return 0;
+    frame[3] = payload;
+    frame[4] = payload >> 8;
+    return length;
+  }
+private:
+  uint8_t* frame;
+  size_t size, length;
+  bool fits;
+};
+
+size_t encodeSchema(uint8_t* frame, size_t size) {
+  FrameWriter writer(frame, size, METRICS_SCHEMA);
+  writer.put16(schemaId());
+  writer.put8(Metric::getCount());
+  for (const Metric* metric = Metric::getFirst(); metric; metric = metric->getNext()) {
+    const Histogram* histogram = static_cast<const Histogram*>(metric);
+    bool isHistogram = metric->getKind() == METRIC_HISTOGRAM;
+    writer.put8(metric->getKind());
+    writer.put8(isHistogram ? histogram->getBoundCount() : 0);
+    for (const char* c = metric->getName(); *c; c++) writer.put8(*c);
+    writer.put8(0);
+    if (!isHistogram) continue;
+    for (int i = 0; i < histogram->getBoundCount(); i++) writer.put32(histogram->getBound(i));
+  }
+  return writer.finish();
+}
+
+size_t encodeSnapshot(uint8_t* frame, size_t size, uint32_t time) {
+  FrameWriter writer(frame, size, METRICS_SNAPSHOT);
+  writer.put32(time);
+  writer.put16(schemaId());
+  for (const Metric* metric = Metric::getFirst(); metric; metric = metric->getNext()) {
+    switch (metric->getKind()) {
+      case METRIC_COUNTER:
+        writer.put32(static_cast<const Counter*>(metric)->get());
+        break;
+      case METRIC_GAUGE:
+        writer.put32(static_cast<const Gauge*>(metric)->get());
+        break;
+      case METRIC_HISTOGRAM: {
+        const Histogram* histogram = static_cast<const Histogram*>(metric);
+        for (int i = 0; i <= histogram->getBoundCount(); i++) writer.put32(histogram->getBucket(i));
+        writer.put32(histogram->getSum());
+        break;
+      }
+    }
+  }
+  return writer.finish();
+}
+
+size_t encodeChunk(uint8_t* frame, size_t size, MetricsFrame type, uint32_t offset, const uint8_t* data,
+                   size_t length) {
+  FrameWriter writer(frame, size, type);
+  writer.put32(offset);
+  for (size_t i = 0; i < length; i++) writer.put8(data[i]);
+  return writer.finish();
+}
+
+uint16_t schemaId() {
+  // FNV-1a over everything the schema frame describes, folded to 16 bits
+  static uint16_t id = 0;
+  if (id) return id;
+  uint32_t hash = 2166136261u;
+  auto mix = [&hash](uint32_t value) {
+    hash ^= value;
+    hash *= 16777619u;
+  };
+  for (const Metric* metric = Metric::getFirst(); metric; metric = metric->getNext()) {
+    mix(metric->getKind());
+    for (const char* c = metric->getName(); *c; c++) mix(*c);
+    if (metric->getKind() != METRIC_HISTOGRAM) continue;
+    const Histogram* histogram = static_cast<const Histogram*>(metric);
+    for (int i = 0; i < histogram->getBoundCount(); i++) mix(histogram->getBound(i));
+  }
+  id = (hash ^ hash >> 16) | 1;
+  return id;
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "heap_tracker.h"
+#include "trace_log.h"
+
+static Gauge freeHeap("sys.free_heap");
+static Gauge minFreeHeap("sys.min_free_heap");
+static Gauge logDropped("log.dropped");
+
+static void exportMetrics(void* context) {
+  static uint8_t frame[METRICS_FRAME_SIZE];
+  TickType_t wake = xTaskGetTickCount();
+  for (int snapshots = 0;; snapshots++) {
+    freeHeap.set(ESP.getFreeHeap());
+    minFreeHeap.set(ESP.getMinFreeHeap());
+    logDropped.set(traceLog.getDropped());
+    sampleHeap();
+    size_t length;
+    if (snapshots % METRICS_SCHEMA_EVERY == 0 && (length = encodeSchema(frame, sizeof(frame)))) {
+      Serial.write(frame, length);
+    }
+    if ((length = encodeSnapshot(frame, sizeof(frame), millis()))) Serial.write(frame, length);
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(METRICS_INTERVAL_MS));
+  }
+}
+
+void startMetricsExport() {
+  // Next to the trace log drain on core 0, away from the game loop
+  xTaskCreatePinnedToCore(exportMetrics, "metrics", 3072, nullptr, 1, nullptr, 0);
+}
+
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Snapshots are sent this often once the exporter is started
+#define METRICS_INTERVAL_MS 1000
+// And the schema every this many snapshots, so a monitor attached late
+// picks it up
+#define METRICS_SCHEMA_EVERY 10
+#define METRICS_MAX_BUCKETS 12
+#define METRICS_FRAME_SIZE 1024
+// Dump bytes per METRICS_REPLAY or METRICS_PPM frame
+#define METRICS_CHUNK_SIZE 512
+
+// Frames share the serial port with the trace log and plain text. Each is
+// the two sync bytes, the frame type (u8), the payload length (u16), the
+// payload and the low byte of its sum. All fields are little endian.
+#define METRICS_SYNC_0 0xA5
+#define METRICS_SYNC_1 0x5B
+
+enum MetricsFrame : uint8_t {
+  // Schema id (u16), metric count (u8), then per metric its kind (u8),
+  // bucket count (u8), name (NUL terminated) and bucket upper bounds (u32
+  // each)
+  METRICS_SCHEMA = 0x01,
+  // Time in ms (u32), schema id (u16), then per metric in schema order a
+  // counter (u32), a gauge (i32) or a histogram's buckets, one more than
+  // its bounds for what's above the last, and sum (u32 each)
+  METRICS_SNAPSHOT = 0x02,
+  // Part of a replay recording dumped with 'r', its offset in the recording
+  // (u32) then the bytes. One without bytes ends the dump. Sent as frames so
+  // the other streams on the port can't end up in the middle of it
+  METRICS_REPLAY = 0x03,
+  // Part of a framebuffer dumped as a PPM image with 'd', laid out like
+  // METRICS_REPLAY
+  METRICS_PPM = 0x04,
+};
+
+enum MetricKind : uint8_t {
+  // Only goes up, rates are left to the monitor
+  METRIC_COUNTER,
+  // Latest value
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM,
+};
+
+// Metrics are static objects that register themselves when constructed, so
+// every module declares its own next to the code that updates them. Updates
+// are single relaxed atomics, safe from any task.
+class Metric {
+public:
+  Metric(const char* name, MetricKind kind);
+  Metric(const Metric&) = delete;
+  const char* getName() const;
+  MetricKind getKind() const;
+  const Metric* getNext() const;
+  static const Metric* getFirst();
+  static int getCount();
+private:
+  const char* name;
+  MetricKind kind;
+  Metric* next;
+
+  static Metric* first;
+  static int count;
+};
+
+class Counter : public Metric {
+public:
+  Counter(const char* name): Metric(name, METRIC_COUNTER), value(0) {}
+
+  void add(uint32_t amount = 1) {
+    value.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  uint32_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+private:
+  std::atomic<uint32_t> value;
+};
+
+class Gauge : public Metric {
+public:
+  Gauge(const char* name): Metric(name, METRIC_GAUGE), value(0) {}
+
+  void set(int32_t to) {
+    value.store(to, std::memory_order_relaxed);
+  }
+
+  int32_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+private:
+  std::atomic<int32_t> value;
+};
+
+// Counts values into fixed buckets, bounds are inclusive upper ones in
+// ascending order and must outlive the histogram
+class Histogram : public Metric {
+public:
+  template <size_t N>
+  Histogram(const char* name, const uint32_t (&bounds)[N]):
+      Metric(name, METRIC_HISTOGRAM), bounds(bounds), boundCount(N), buckets{}, sum(0) {
+    static_assert(N < METRICS_MAX_BUCKETS, "Too many histogram buckets");
+  }
+
+  void record(uint32_t value) {
+    int i = 0;
+    while (i < boundCount && value > bounds[i]) i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  int getBoundCount() const {
+    return boundCount;
+  }
+
+  uint32_t getBound(int i) const {
+    return bounds[i];
+  }
+
+  uint32_t getBucket(int i) const {
+    return buckets[i].load(std::memory_order_relaxed);
+  }
+
+  uint32_t getSum() const {
+    return sum.load(std::memory_order_relaxed);
+  }
+private:
+  const uint32_t* bounds;
+  int boundCount;
+  std::atomic<uint32_t> buckets[METRICS_MAX_BUCKETS];
+  std::atomic<uint32_t> sum;
+};
+
+// Writes whole frames, returns their size or 0 if they don't fit
+size_t encodeSchema(uint8_t* frame, size_t size);
+size_t encodeSnapshot(uint8_t* frame, size_t size, uint32_t time);
+// A METRICS_REPLAY or METRICS_PPM frame
+size_t encodeChunk(uint8_t* frame, size_t size, MetricsFrame type, uint32_t offset, const uint8_t* data,
+                   size_t length);
+// Schema id of the registered metrics, a snapshot only matches the schema
+// with the same one
+uint16_t schemaId();
+
+// Starts a low priority task that samples the system gauges and streams
+// frames to Serial. Firmware only.
+void startMetricsExport();
@@ -0,0 +1,241 @@
+// Metrics monitor. Reads serial output from a board, or captured files, and
+// redraws a table of its metrics on every snapshot. Counters show their rate
+// and histograms their percentiles over the last interval. Everything else
+// on the port is skipped. With -p snapshots are printed one after the other instead.
+//   pio device monitor --raw | .pio/build/metrics/program
+#ifndef ARDUINO
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "metrics.h"
+
+typedef struct MetricInfo {
+  MetricKind kind;
+  std::string name;
+  std::vector<uint32_t> bounds;
+} MetricInfo;
+
+// Values of one snapshot, histograms take their buckets then their sum
+typedef struct Snapshot {
+  uint32_t time;
+  std::vector<uint32_t> values;
+} Snapshot;
+
+class Reader {
+public:
+  Reader(const uint8_t* data, size_t length): data(data), length(length), at(0), valid(true) {}
+
+  uint32_t get(int bytes) {
+    if (at + bytes > length) {
+      valid = false;
+      return 0;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint32_t) data[at++] << (8 * i);
+    return value;
+  }
+
+  std::string getString() {
+    std::string text;
+    while (at < length && data[at]) text += data[at++];
+    valid = valid && at < length;
+    at++;
+    return text;
+  }
+
+  bool isValid() {
+    return valid && at == length;
+  }
+private:
+  const uint8_t* data;
+  size_t length, at;
+  bool valid;
+};
+
+class Monitor {
+public:
+  Monitor(bool plain): plain(plain), schemaId(0), hasPrevious(false), frames(0), rejected(0) {}
+
+  void frame(uint8_t type, const uint8_t* payload, size_t length) {
+    Reader reader(payload, length);
+    if (type == METRICS_SCHEMA) schema(reader);
+    else if (type == METRICS_SNAPSHOT) snapshot(reader);
+  }
+
+  void reject() {
+    rejected++;
+  }
+
+  void report() {
+    fprintf(stderr, "%u snapshots, %u bad frames\n", frames, rejected);
+  }
+private:
+  bool plain;
+  uint16_t schemaId;
+  std::vector<MetricInfo> metrics;
+  Snapshot previous;
+  bool hasPrevious;
+  uint32_t frames, rejected;
+
+  void schema(Reader& reader) {
+    uint16_t id = reader.get(2);
+    if (id == schemaId) return;
+    std::vector<MetricInfo> parsed(reader.get(1));
+    for (MetricInfo& metric : parsed) {
+      metric.kind = (MetricKind) reader.get(1);
+      int boundCount = reader.get(1);
+      metric.name = reader.getString();
+      for (int i = 0; i < boundCount; i++) metric.bounds.push_back(reader.get(4));
+    }
+    if (!reader.isValid()) {
+      rejected++;
+      return;
+    }
+    schemaId = id;
+    metrics = parsed;
+    hasPrevious = false;
+  }
+
+  void snapshot(Reader& reader) {
+    Snapshot current;
+    current.time = reader.get(4);
+    // Until the next schema comes around there's no telling what's in it
+    if (reader.get(2) != schemaId || !schemaId) return;
+    for (const MetricInfo& metric : metrics) {
+      int fields = metric.kind == METRIC_HISTOGRAM ? metric.bounds.size() + 2 : 1;
+      for (int i = 0; i < fields; i++) current.values.push_back(reader.get(4));
+    }
+    if (!reader.isValid()) {
+      rejected++;
+      return;
+    }
+    // The board restarted, so everything starts over
+    if (hasPrevious && current.time < previous.time) hasPrevious = false;
+    frames++;
+    draw(current);
+    previous = current;
+    hasPrevious = true;
+  }
+
+  void draw(const Snapshot& current) {
+    double seconds = hasPrevious ? (current.time - previous.time) / 1000.0 : 0;
+    if (!plain) printf("\x1b[H\x1b[2J");
+    printf("Board time %.1f s\n", current.time / 1000.0);
+    printf("%-24s %12s %10s\n", "Metric", "Value", "Per second");
+    size_t at = 0;
+    for (const MetricInfo& metric : metrics) {
+      const uint32_t* values = &current.values[at];
+      const uint32_t* before = hasPrevious ? &previous.values[at] : nullptr;
+      switch (metric.kind) {
+        case METRIC_COUNTER:
+          if (before && seconds > 0) printf("%-24s %12u %10.1f\n", metric.name.c_str(), values[0], (values[0] - before[0]) / seconds);
+          else printf("%-24s %12u\n", metric.name.c_str(), values[0]);
+          break;
+        case METRIC_GAUGE:
+          printf("%-24s %12d\n", metric.name.c_str(), (int32_t) values[0]);
+          break;
+        case METRIC_HISTOGRAM:
+          drawHistogram(metric, values, before);
+          break;
+      }
+      at += metric.kind == METRIC_HISTOGRAM ? metric.bounds.size() + 2 : 1;
+    }
+    if (!plain) printf("\n");
+    fflush(stdout);
+  }
+
+  // Percentiles are the upper bound of the bucket they land in
+  void drawHistogram(const MetricInfo& metric, const uint32_t* values, const uint32_t* before) {
+    int buckets = metric.bounds.size() + 1;
+    std::vector<uint32_t> counts(buckets);
+    uint32_t count = 0;
+    for (int i = 0; i < buckets; i++) {
+      counts[i] = values[i] - (before ? before[i] : 0);
+      count += counts[i];
+    }
+    uint32_t sum = values[buckets] - (before ? before[buckets] : 0);
+    printf("%-24s %12u %10s", metric.name.c_str(), count, "");
+    if (!count) {
+      printf("\n");
+      return;
+    }
+    printf(" mean %u", sum / count);
+    const int perMille[] = {500, 900, 990};
+    const char* labels[] = {"p50", "p90", "p99"};
+    for (int p = 0; p < 3; p++) {
+      uint32_t target = (uint64_t) count * perMille[p] / 1000;
+      uint32_t seen = 0;
+      int i = 0;
+      while (i < buckets - 1 && (seen += counts[i]) <= target) i++;
+      if (i < buckets - 1) printf(" %s <=%u", labels[p], metric.bounds[i]);
+      else printf(" %s >%u", labels[p], metric.bounds.back());
+    }
+    printf("\n");
+  }
+};
+
+// Picks metrics frames out of everything else on the port. A trace log
+// record can look like the start of a frame, so when a frame turns out bad
+// its bytes are scanned again from just after where it seemed to start.
+class FrameParser {
+public:
+  FrameParser(Monitor& monitor): monitor(monitor) {}
+
+  void feed(uint8_t byte) {
+    if (pending.empty()) {
+      if (byte == METRICS_SYNC_0) pending.push_back(byte);
+      return;
+    }
+    pending.push_back(byte);
+    size_t size = pending.size();
+    if (size == 2 && byte != METRICS_SYNC_1) return rescan();
+    if (size == 3 && byte != METRICS_SCHEMA && byte != METRICS_SNAPSHOT) return rescan();
+    if (size < 5) return;
+    size_t length = pending[3] | pending[4] << 8;
+    if (length > METRICS_FRAME_SIZE) return rescan();
+    if (size < length + 6) return;
+
+    uint8_t sum = 0;
+    for (size_t i = 5; i < size - 1; i++) sum += pending[i];
+    if (sum != pending.back()) {
+      monitor.reject();
+      return rescan();
+    }
+    monitor.frame(pending[2], &pending[5], length);
+    pending.clear();
+  }
+private:
+  Monitor& monitor;
+  // Bytes since the last sync byte that could start a frame
+  std::vector<uint8_t> pending;
+
+  void rescan() {
+    std::vector<uint8_t> bytes;
+    bytes.swap(pending);
+    for (size_t i = 1; i < bytes.size(); i++) feed(bytes[i]);
+  }
+};
+
+int main(int argc, char** argv) {
+  int first = 1;
+  bool plain = argc > 1 && !strcmp(argv[1], "-p");
+  if (plain) first++;
+  Monitor monitor(plain);
+  FrameParser parser(monitor);
+  for (int i = first; i < argc || i == first; i++) {
+    FILE* file = i < argc ? fopen(argv[i], "rb") : stdin;
+    if (!file) {
+      fprintf(stderr, "Can't open %s\n", argv[i]);
+      return 1;
+    }
+    int byte;
+    while ((byte = fgetc(file)) != EOF) parser.feed(byte);
+    if (file != stdin) fclose(file);
+  }
+  monitor.report();
+  return 0;
+}
+
+#endif
@@ -2,35 +2,130 @@
 #include "esp_now.h"
 #include "esp_wifi.h"
 #include "game.h"
+#include "menu.h"
+#include "metrics.h"
 #include "network.h"
+#include "trace_log.h"
+
+Network* Network::active = nullptr;
+
+static const uint32_t callbackBounds[] = {5, 10, 20, 50, 100, 500, 1000};
+static const uint32_t startBounds[] = {10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+static Counter ticksSent("net.ticks_sent");
+static Counter sendFailures("net.send_failures");
+static Counter ticksReceived("net.ticks_received");
+static Counter invalidTicks("net.invalid_ticks");
+static Counter eventsDropped("net.events_dropped");
+// Time the receive callbacks hold the Wi-Fi task
+static Histogram callbackTime("net.callback_us", callbackBounds);
+// Only paid once per boot, as the radio stays up afterwards
+static Histogram startTime("net.start_us", startBounds);
 
 Network::Network(Game *game):
+        started(false),
         channel(1),
-        remoteTick(nullptr),
+        discoveredPeers{},
+        discoveredCount(0),
+        reportedDropped(0),
+        remoteTick{},
         isNewTick(false),
-        remoteTickMutex(xSemaphoreCreateMutex()) {
+        tickArrival(0) {
     this->game = game;
-    xSemaphoreGive(remoteTickMutex);
 }
 
 void Network::init() {
+    active = this;
+    if (started) return;
+    uint32_t start = micros();
     char message[100];
     WiFi.disconnect();
     WiFi.mode(WIFI_STA);
     esp_err_t result = esp_now_init();
     if (result != ESP_OK) {
-        Serial.printf("Failed to initialize ESP-NOW: %x\n", result);
+        logEvent<LOG_ESPNOW_FAILED>(result);
         snprintf(message, 100, "Failed to initialize ESP-NOW");
         game->getGraphics()->showMessage("Error", message);
+        return;
     }
+    started = true;
+    startTime.record(micros() - start);
+}
+
+void Network::stop() {
+    if (!started) return;
+    esp_now_unregister_recv_cb();
+    uint8_t* mac = game->getPeer();
+    if (esp_now_is_peer_exist(mac)) esp_now_del_peer(mac);
+    resetDiscovered();
+    isNewTick = false;
+    // Whatever arrived for this session goes with it
+    RadioEvent event;
+    while (events.pop(event)) {}
 }
 
-void Network::deinit() {
-    esp_now_deinit();
+void Network::poll() {
+    RadioEvent event;
+    while (events.pop(event)) handle(event);
+    uint32_t dropped = events.getDropped();
+    if (dropped != reportedDropped) {
+        logEvent<LOG_RADIO_DROPPED>(dropped - reportedDropped);
+        eventsDropped.add(dropped - reportedDropped);
+        reportedDropped = dropped;
+    }
+}
+
+void Network::handle(RadioEvent& event) {
+    uint8_t* mac = event.mac;
+    switch (event.type) {
+        case RADIO_DISCOVERY_REQUEST: {
+            logEvent<LOG_DISCOVERY_RECEIVED>(macHigh(mac), macLow(mac));
+            uint8_t ack[2] = {'A', 'D'}; // Acknowledge Discovery
+            esp_now_peer_info_t peerInfo = {};
+            memcpy(peerInfo.peer_addr, mac, 6);
+            peerInfo.channel = getChannel();
+            esp_now_add_peer(&peerInfo);
+            esp_now_send(mac, ack, 2);
+            esp_now_del_peer(mac);
+            break;
+        }
+        case RADIO_JOIN_REQUEST: {
+            logEvent<LOG_JOIN_RECEIVED>(macHigh(mac), macLow(mac));
+            // Acknowledge Join - This is not accept, it's just an acknowledgement
+            uint8_t ack[2] = {'A', 'J'};
+            game->getMenu()->handleJoinRequestReceived(mac);
+            esp_now_send(mac, ack, 2);
+            break;
+        }
+        case RADIO_DISCOVERY_RESPONSE:
+            logEvent<LOG_DISCOVERY_RESPONSE>(macHigh(mac), macLow(mac));
+            addDiscoveredPeer(mac);
+            break;
+        case RADIO_JOIN_ACKNOWLEDGED:
+            logEvent<LOG_JOIN_ACKNOWLEDGED>(macHigh(mac), macLow(mac));
+            // TODO: Maybe set a screen between join request and join request acknowledged
+            waitJoinResponse();
+            break;
+        case RADIO_JOIN_ACCEPTED:
+            logEvent<LOG_ACCEPT_RECEIVED>(macHigh(mac), macLow(mac));
+            game->setPeer(mac);
+            game->getMenu()->handleJoinRequestAccepted(event.seed);
+            break;
+        case RADIO_JOIN_DECLINED:
+            logEvent<LOG_DECLINE_RECEIVED>(macHigh(mac), macLow(mac));
+            game->getMenu()->handleJoinRequestDeclined();
+            break;
+        case RADIO_TICK:
+            // Only the latest counts, a missed tick is caught up by the next one
+            remoteTick = event.tick;
+            tickArrival = event.time;
+            isNewTick = true;
+            break;
+    }
 }
 
 void Network::resetDiscovered() {
-    discoveredPeers.clear();
+    discoveredCount = 0;
 }
 
 void Network::enableDiscovery() {
@@ -40,9 +135,6 @@ void Network::enableDiscovery() {
 void Network::discover() {
     uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     uint8_t discovery[1] = {'D'};
-    Serial.printf("Sending discovery message\n");
-    Serial.printf("MAC: %02x:%02x:%02x:%02x:%02x:%02x\n", broadcastMac[0], broadcastMac[1], broadcastMac[2], broadcastMac[3], broadcastMac[4], broadcastMac[5]);
-
     esp_now_peer_info_t peerInfo = {};
     memcpy(peerInfo.peer_addr, broadcastMac, 6);
     peerInfo.channel = channel;
@@ -53,15 +145,19 @@ void Network::discover() {
 
     esp_err_t result = esp_now_send(broadcastMac, discovery, 1);
     if (result == ESP_OK) {
-        Serial.printf("Discovery message sent");
+        logEvent<LOG_DISCOVERY_SENT>();
     } else {
-        Serial.printf("Failed to send discovery message: %d\n", result);
+        logEvent<LOG_DISCOVERY_FAILED>(result);
     }
     esp_now_del_peer(broadcastMac);
 }
 
-std::vector<uint8_t*> Network::getDiscovered() {
-    return discoveredPeers;
+int Network::getDiscoveredCount() {
+    return discoveredCount;
+}
+
+const uint8_t* Network::getDiscovered(int index) {
+    return discoveredPeers[index];
 }
 
 int Network::getChannel() {
@@ -71,37 +167,26 @@ int Network::getChannel() {
     return pChannel;
 }
 
-uint8_t* Network::getMac() {
-    uint8_t* mac = new uint8_t[6];
+void Network::getMac(uint8_t* mac) {
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
-    return mac;
-}
-
-String Network::getMacString() {
-    return WiFi.macAddress();
 }
 
-String Network::stringFromMac(uint8_t* mac) {
-    char macStr[18];
-    snprintf(macStr, sizeof(macStr), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-    return String(macStr);
+void Network::stringFromMac(const uint8_t* mac, char* text) {
+    snprintf(text, MAC_STRING_LENGTH, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 }
 
-uint8_t* Network::macFromString(String mac) {
-    uint8_t* macAddr = new uint8_t[6];
-    sscanf(mac.c_str(), "%02x:%02x:%02x:%02x:%02x:%02x", &macAddr[0], &macAddr[1], &macAddr[2], &macAddr[3], &macAddr[4], &macAddr[5]);
-    return macAddr;
+bool Network::macFromString(const char* text, uint8_t* mac) {
+    return sscanf(text, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == MAC_LENGTH;
 }
 
-SemaphoreHandle_t Network::getRemoteTickMutex() {
-    return remoteTickMutex;
-}
-
-void Network::addDiscoveredPeer(uint8_t* mac) {
-    if (std::find(discoveredPeers.begin(), discoveredPeers.end(), mac) != discoveredPeers.end()) {
-        return;
+void Network::addDiscoveredPeer(const uint8_t* mac) {
+    int count = discoveredCount;
+    if (count == MAX_DISCOVERED) return;
+    for (int i = 0; i < count; i++) {
+        if (memcmp(discoveredPeers[i], mac, MAC_LENGTH) == 0) return;
     }
-    discoveredPeers.push_back(mac);
+    memcpy(discoveredPeers[count], mac, MAC_LENGTH);
+    discoveredCount = count + 1;
 }
 
 void Network::setPeer(uint8_t* mac) {
@@ -112,17 +197,20 @@ void Network::setPeer(uint8_t* mac) {
     esp_now_add_peer(&peerInfo);
 }
 
-void Network::sendTick(RemoteTick* tick) {
+void Network::sendTick(const RemoteTick& tick) {
     uint8_t* mac = game->getPeer();
     if (!mac) {
-        Serial.println("Peer MAC not set");
+        logEvent<LOG_PEER_NOT_SET>();
         return;
     }
 
-    esp_err_t result = esp_now_send(mac, (uint8_t*)tick, sizeof(RemoteTick));
+    esp_err_t result = esp_now_send(mac, (const uint8_t*)&tick, sizeof(RemoteTick));
     if (result != ESP_OK) {
-        Serial.printf("Failed to send remote tick: %d\n", result);
+        logEvent<LOG_TICK_SEND_FAILED>(result);
+        sendFailures.add();
+        return;
     }
+    ticksSent.add();
 }
 
 RemoteTick* Network::receiveTick() {
@@ -131,17 +219,11 @@ RemoteTick* Network::receiveTick() {
     }
 
     isNewTick = false;
-    return remoteTick.get();
+    return &remoteTick;
 }
 
-void Network::setRemoteTick(std::unique_ptr<RemoteTick> tick) {
-    if (xSemaphoreTake(remoteTickMutex, portMAX_DELAY) != pdTRUE) {
-        Serial.println("Failed to take mutex");
-        return;
-    }
-    remoteTick = std::move(tick);
-    xSemaphoreGive(remoteTickMutex);
-    isNewTick = true;
+uint32_t Network::getTickArrival() {
+    return tickArrival;
 }
 
 void Network::waitJoinResponse() {
@@ -149,17 +231,7 @@ void Network::waitJoinResponse() {
 }
 
 void Network::requestJoin(uint8_t* mac) {
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
-        return;
-    }
-
-    Menu* menu = game->getMenu();
     uint8_t join[1] = {'J'};
-    Serial.printf("Sending join message to ");
-    Serial.printf("%02x:%02x:%02x:%02x:%02x:%02x\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-
     esp_now_peer_info_t peerInfo = {};
     memcpy(peerInfo.peer_addr, mac, 6);
     peerInfo.channel = channel;
@@ -170,170 +242,115 @@ void Network::requestJoin(uint8_t* mac) {
 
     esp_err_t result = esp_now_send(mac, join, 1);
     if (result == ESP_OK) {
-        Serial.println("Join message sent");
+        logEvent<LOG_JOIN_SENT>(macHigh(mac), macLow(mac));
     } else {
-        Serial.printf("Failed to send join message: %d\n", result);
+        logEvent<LOG_JOIN_FAILED>(result);
     }
 }
 
-void Network::acceptJoin() {
+void Network::acceptJoin(uint32_t seed) {
     uint8_t* mac = game->getPeer();
     if (!mac) {
-        Serial.println("Peer MAC not set");
+        logEvent<LOG_PEER_NOT_SET>();
         return;
     }
 
-    uint8_t accept[3] = {'A', 'J', 'A'};
-    esp_err_t result = esp_now_send(mac, accept, 3);
+    uint8_t accept[7] = {'A', 'J', 'A'};
+    memcpy(accept + 3, &seed, sizeof(seed));
+    esp_err_t result = esp_now_send(mac, accept, sizeof(accept));
     if (result == ESP_OK) {
-        Serial.println("Join accepted");
+        logEvent<LOG_ACCEPT_SENT>();
     } else {
-        Serial.printf("Failed to accept join: %d\n", result);
+        logEvent<LOG_ACCEPT_FAILED>(result);
     }
 }
 
 void Network::declineJoin() {
     uint8_t* mac = game->getPeer();
     if (!mac) {
-        Serial.println("Peer MAC not set");
+        logEvent<LOG_PEER_NOT_SET>();
         return;
     }
 
-    Serial.printf("Declining join from %s\n", stringFromMac(mac).c_str());
-    Serial.printf("Host is added? %d\n", esp_now_is_peer_exist(mac));
-
     uint8_t decline[3] = {'A', 'J', 'D'};
     esp_err_t result = esp_now_send(mac, decline, 3);
     esp_now_del_peer(mac);
     if (result == ESP_OK) {
-        Serial.println("Join declined");
+        logEvent<LOG_DECLINE_SENT>(macHigh(mac), macLow(mac));
     } else {
-        Serial.printf("Failed to decline join: %d\n", result);
+        logEvent<LOG_DECLINE_FAILED>(result);
     }
 }
 
 void Network::setMultiplayerHandlers() {
-    Serial.printf("Remote peer MAC: %s\n", stringFromMac(game->getPeer()).c_str());
-    Serial.printf("ESP-NOW is peer exist? %d\n", esp_now_is_peer_exist(game->getPeer()));
+    uint8_t* mac = game->getPeer();
     esp_now_register_recv_cb(Network::remoteTickCallback);
-    Serial.println("Multiplayer handlers set");
+    logEvent<LOG_MULTIPLAYER_HANDLERS>(macHigh(mac), macLow(mac), esp_now_is_peer_exist(mac));
 }
 
-void Network::discoveryRequestCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
+// Runs on the Wi-Fi task, so the message is only copied into the queue
+void Network::queue(RadioEventType type, const uint8_t* mac, uint32_t time, const uint8_t* payload, int length) {
+    Network* network = Network::active;
+    if (!network) {
+        logEvent<LOG_NOT_INITIALIZED>();
         return;
     }
+    RadioEvent event;
+    event.time = time;
+    event.type = type;
+    memcpy(event.mac, mac, MAC_LENGTH);
+    if (payload) memcpy(&event.tick, payload, length);
+    network->events.push(event);
+}
 
-    Serial.printf("Received discovery from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    Serial.printf("Data: %s\n", std::string((char*)data, data_len).c_str());
-
-    Menu* menu = game->getMenu();
-    Network* network = game->getNetwork();
-    uint8_t ack[2] = {'A', 'P'}; // Acknowledge Packet
-    if (data_len == 1) {
-        if (data[0] == 'D') {
-            Serial.printf("Received discovery from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-            ack[1] = 'D'; // Acknowledge Discovery
-
-            esp_now_peer_info_t peerInfo = {};
-            memcpy(peerInfo.peer_addr, mac_addr, 6);
-            peerInfo.channel = network->getChannel();
-            esp_now_add_peer(&peerInfo);
-            esp_now_send(mac_addr, ack, 2);
-            esp_now_del_peer(mac_addr);
-            return;
-        } else if (data[0] == 'J') {
-            Serial.printf("Received join request from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-            ack[1] = 'J'; // Acknowledge Join - This is not accept, it's just an acknowledgement
-
-            menu->handleJoinRequestReceived((uint8_t*)mac_addr);
-            esp_now_send(mac_addr, ack, 2);
-            return;
-        }
+void Network::discoveryRequestCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
+    uint32_t start = micros();
+    if (data_len == 1 && data[0] == 'D') {
+        queue(RADIO_DISCOVERY_REQUEST, mac_addr, start);
+    } else if (data_len == 1 && data[0] == 'J') {
+        queue(RADIO_JOIN_REQUEST, mac_addr, start);
+    } else {
+        logEvent<LOG_UNKNOWN_MESSAGE>(macHigh(mac_addr), macLow(mac_addr), data_len);
     }
-    Serial.println("Unknown message");
+    callbackTime.record(micros() - start);
 }
 
 void Network::discoveryResponseCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    Serial.printf("Received response from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
-        return;
-    }
-
-    Network* network = game->getNetwork();
-    if (data_len == 2) {
-        if (data[0] == 'A' && data[1] == 'D') {
-            uint8_t newMac[6];
-            for (int i = 0; i < 6; i++) {
-                newMac[i] = mac_addr[i];
-            }
-            network->addDiscoveredPeer(newMac);
-            return;
-        }
+    uint32_t start = micros();
+    if (data_len == 2 && data[0] == 'A' && data[1] == 'D') {
+        queue(RADIO_DISCOVERY_RESPONSE, mac_addr, start);
     }
+    callbackTime.record(micros() - start);
 }
 
 void Network::joinRequestCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
-        return;
-    }
-
-    Menu* menu = game->getMenu();
-    Network* network = game->getNetwork();
-    if (data_len == 2) {
-        if (data[0] == 'A' && data[1] == 'J') {
-            Serial.printf("Acknowledge join request from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-            // TODO: Maybe set a screen between join request and join request acknowledged
-            esp_now_register_recv_cb(Network::joinResponseCallback);
-            return;
-        }
+    uint32_t start = micros();
+    if (data_len == 2 && data[0] == 'A' && data[1] == 'J') {
+        queue(RADIO_JOIN_ACKNOWLEDGED, mac_addr, start);
     }
+    callbackTime.record(micros() - start);
 }
 
 void Network::joinResponseCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
-        return;
-    }
-
-    Menu* menu = game->getMenu();
-    Network* network = game->getNetwork();
-    if (data_len == 3) {
-        if (data[0] == 'A' && data[1] == 'J') {
-            if (data[2] == 'A') {
-                Serial.printf("Received join accept from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-                game->setPeer((uint8_t*)mac_addr);
-                menu->handleJoinRequestAccepted();
-                return;
-            } else if (data[2] == 'D') {
-                Serial.printf("Received join decline from %02x:%02x:%02x:%02x:%02x:%02x\n", mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-                menu->handleJoinRequestDeclined();
-                return;
-            }
+    uint32_t start = micros();
+    if (data_len >= 3 && data[0] == 'A' && data[1] == 'J') {
+        if (data[2] == 'A' && data_len == 7) {
+            queue(RADIO_JOIN_ACCEPTED, mac_addr, start, data + 3, sizeof(uint32_t));
+        } else if (data[2] == 'D' && data_len == 3) {
+            queue(RADIO_JOIN_DECLINED, mac_addr, start);
         }
     }
+    callbackTime.record(micros() - start);
 }
 
 void Network::remoteTickCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    Game* game = Game::instance;
-    if (!game) {
-        Serial.println("Game instance not found");
-        return;
-    }
-
-    Network* network = game->getNetwork();
+    uint32_t start = micros();
     if (data_len != sizeof(RemoteTick)) {
-        Serial.printf("Invalid tick size: %d\n", data_len);
+        logEvent<LOG_INVALID_TICK>(data_len);
+        invalidTicks.add();
+    } else {
+        ticksReceived.add();
+        queue(RADIO_TICK, mac_addr, start, data, sizeof(RemoteTick));
     }
-
-    std::unique_ptr<RemoteTick> tick(new RemoteTick());
-    memcpy(tick.get(), data, sizeof(RemoteTick));
-    network->setRemoteTick(std::move(tick));
+    callbackTime.record(micros() - start);
 }
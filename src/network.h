@@ -1,49 +1,106 @@
 #pragma once
 
 #include <iostream>
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
 #include <string>
-#include <vector>
 #include "esp_now.h"
 #include "esp_wifi.h"
 #include "game.h"
+#include "spsc_queue.h"
+#include "sync.h"
+
+#define MAC_LENGTH 6
+// "xx:xx:xx:xx:xx:xx" and the terminator
+#define MAC_STRING_LENGTH 18
+#define MAX_DISCOVERED 8
+// Must be a power of two
+#define RADIO_QUEUE_SIZE 16
 
 class Game;
-typedef struct RemoteTick RemoteTick;
 
+// What the receive callbacks hand over to the loop
+enum RadioEventType : uint8_t {
+    RADIO_DISCOVERY_REQUEST,
+    RADIO_DISCOVERY_RESPONSE,
+    RADIO_JOIN_REQUEST,
+    RADIO_JOIN_ACKNOWLEDGED,
+    RADIO_JOIN_ACCEPTED,
+    RADIO_JOIN_DECLINED,
+    RADIO_TICK
+};
+
+typedef struct RadioEvent {
+    uint32_t time; // micros() when it was received
+    RadioEventType type;
+    uint8_t mac[MAC_LENGTH];
+    // Whichever the type carries, copied straight from the message
+    union {
+        // RADIO_TICK
+        RemoteTick tick;
+        // RADIO_JOIN_ACCEPTED, the host's match seed
+        uint32_t seed;
+    };
+} RadioEvent;
+
+// Filled by the receive callbacks on the Wi-Fi task and drained by the loop
+typedef SpscQueue<RadioEvent, RADIO_QUEUE_SIZE> RadioQueue;
+
+// The receive callbacks run on the Wi-Fi task, so all they do is queue what
+// arrived. Replies, menus and the game only ever change from the loop, in
+// poll().
 class Network {
 public:
     Network(Game* game);
+    // Brings up Wi-Fi and ESP-NOW the first time, later calls only make this
+    // the active network again
     void init();
-    void deinit();
+    // Forgets the session, receive callback and peer, but keeps the radio up
+    void stop();
+    // Handles whatever the receive callbacks queued, called on every pass of
+    // the loop
+    void poll();
     void resetDiscovered();
     void enableDiscovery();
     void discover();
-    std::vector<uint8_t*> getDiscovered();
+    int getDiscoveredCount();
+    const uint8_t* getDiscovered(int index);
     int getChannel();
-    uint8_t* getMac();
-    String getMacString();
-    String stringFromMac(uint8_t* mac);
-    uint8_t* macFromString(String mac);
-    SemaphoreHandle_t getRemoteTickMutex();
-    void addDiscoveredPeer(uint8_t* mac);
+    void getMac(uint8_t* mac);
+    // Text needs MAC_STRING_LENGTH bytes
+    static void stringFromMac(const uint8_t* mac, char* text);
+    static bool macFromString(const char* text, uint8_t* mac);
+    void addDiscoveredPeer(const uint8_t* mac);
     void setPeer(uint8_t* mac);
-    void sendTick(RemoteTick* tick);
+    void sendTick(const RemoteTick& tick);
+    // The latest tick handed over by poll(), if there was one since the last
+    // call
     RemoteTick* receiveTick();
-    void setRemoteTick(std::unique_ptr<RemoteTick> tick);
+    // micros() when the last tick arrived
+    uint32_t getTickArrival();
     void waitJoinResponse();
     void requestJoin(uint8_t* mac);
-    void acceptJoin();
+    // The accept carries the seed both boards start the match from
+    void acceptJoin(uint32_t seed);
     void declineJoin();
     void setMultiplayerHandlers();
 private:
+    // ESP-NOW receive callbacks carry no context, so they reach the network
+    // that last initialized the radio through here
+    static Network* active;
+
     Game* game;
+    bool started;
     uint8_t channel;
-    std::vector<uint8_t*> discoveredPeers;
-    std::unique_ptr<RemoteTick> remoteTick;
-    SemaphoreHandle_t remoteTickMutex;
+    uint8_t discoveredPeers[MAX_DISCOVERED][MAC_LENGTH];
+    int discoveredCount;
+    RadioQueue events;
+    uint32_t reportedDropped;
+    RemoteTick remoteTick;
     bool isNewTick;
+    uint32_t tickArrival;
+
+    void handle(RadioEvent& event);
+    static void queue(RadioEventType type, const uint8_t* mac, uint32_t time, const uint8_t* payload = nullptr,
+                      int length = 0);
 
     static void discoveryRequestCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len);
     static void discoveryResponseCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len);
@@ -1,37 +1,22 @@
 #pragma once
 
-#include <TFT_eSPI.h>
-
-#include "ball.h"
-#include "game.h"
+#include "draw_list.h"
 #include "macros.h"
-#include "paddle.h"
-#include "player.h"
-
-class Ball;
-class Player;
+#include "simulation.h"
 
+// Draws one paddle of a GameState through the draw list, the movement rules
+// live in simulation.h
 class Paddle {
 public:
-  Paddle(int pos):
-      pos(pos),
-      player(nullptr),
-      width(30),
-      height(4) {
-    pos = pos - width / 2;
-  }
-  void render(bool force = false);
-  void setPlayer(Player* player);
-  void setPos(int pos);
-  void centralize();
-  int bounce(Ball* ball);
+  Paddle(const PaddleState* state, PaddleSlot slot, int sprite):
+      state(state),
+      slot(slot),
+      sprite(sprite) {}
+  void render(DrawList* drawList);
+  Rect getBounds();
   int getPos();
-  int getHeight();
-  int getWidth();
-  void reset();
 private:
-  int pos;
-  int width;
-  int height;
-  Player* player;
-};
\ No newline at end of file
+  const PaddleState* state;
+  PaddleSlot slot;
+  int sprite;
+};
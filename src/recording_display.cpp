@@ -0,0 +1,173 @@
+#include "recording_display.h"
+
+RecordingDisplay::RecordingDisplay(TFT_eSPI* panel):
+    TFT_eSprite(panel),
+    panel(panel),
+    mirror(true),
+    nested(0),
+    transparentText(false),
+    frameCount(0),
+    frame{0, 0},
+    total{0, 0} {
+  resetDamage();
+}
+
+void RecordingDisplay::init() {
+  panel->init();
+  setColorDepth(16);
+  if (!createSprite(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+    Serial.println("Failed to allocate recording framebuffer");
+  }
+}
+
+void RecordingDisplay::setRotation(uint8_t rotation) {
+  // The framebuffer is kept in panel coordinates, only the panel rotates
+  panel->setRotation(rotation);
+}
+
+void RecordingDisplay::drawPixel(int32_t x, int32_t y, uint32_t color) {
+  if (!nested || transparentText) record(x, y, 1, 1);
+  nested++;
+  TFT_eSprite::drawPixel(x, y, color);
+  nested--;
+}
+
+void RecordingDisplay::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size) {
+  bool outer = !nested;
+  if (outer) {
+    // With a background the whole glyph cell goes out in a single window,
+    // transparent glyphs are drawn pixel by pixel
+    transparentText = color == bg;
+    if (!transparentText) record(x, y, 6 * size, 8 * size);
+  }
+  nested++;
+  TFT_eSprite::drawChar(x, y, c, color, bg, size);
+  nested--;
+  if (outer) transparentText = false;
+}
+
+int16_t RecordingDisplay::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font) {
+  bool outer = !nested;
+  if (outer) transparentText = textcolor == textbgcolor;
+  nested++;
+  int16_t advance = TFT_eSprite::drawChar(uniCode, x, y, font);
+  nested--;
+  if (outer) {
+    if (!transparentText) record(x, y, advance, fontHeight(font));
+    transparentText = false;
+  }
+  return advance;
+}
+
+int16_t RecordingDisplay::drawChar(uint16_t uniCode, int32_t x, int32_t y) {
+  return drawChar(uniCode, x, y, textfont);
+}
+
+void RecordingDisplay::drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) {
+  if (!nested || transparentText) record(x, y, 1, h);
+  nested++;
+  TFT_eSprite::drawFastVLine(x, y, h, color);
+  nested--;
+}
+
+void RecordingDisplay::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) {
+  if (!nested || transparentText) record(x, y, w, 1);
+  nested++;
+  TFT_eSprite::drawFastHLine(x, y, w, color);
+  nested--;
+}
+
+void RecordingDisplay::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  if (!nested || transparentText) record(x, y, w, h);
+  nested++;
+  TFT_eSprite::fillRect(x, y, w, h, color);
+  nested--;
+}
+
+void RecordingDisplay::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data) {
+  if (!nested) record(x, y, w, h);
+  nested++;
+  TFT_eSprite::pushImage(x, y, w, h, data);
+  nested--;
+}
+
+FrameStats RecordingDisplay::endFrame() {
+  if (mirror && damageX1 > damageX0 && damageY1 > damageY0) {
+    pushSprite(damageX0, damageY0, damageX0, damageY0, damageX1 - damageX0, damageY1 - damageY0);
+  }
+  FrameStats stats = frame;
+  total.pixels += frame.pixels;
+  total.windows += frame.windows;
+  frame = {0, 0};
+  frameCount++;
+  resetDamage();
+  return stats;
+}
+
+FrameStats RecordingDisplay::getFrameStats() {
+  return frame;
+}
+
+FrameStats RecordingDisplay::getTotalStats() {
+  return total;
+}
+
+uint32_t RecordingDisplay::getFrameCount() {
+  return frameCount;
+}
+
+void RecordingDisplay::setMirror(bool mirror) {
+  this->mirror = mirror;
+}
+
+void RecordingDisplay::dumpPPM(ImageSink sink, void* context) {
+  char header[32];
+  int length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+  sink(context, (const uint8_t*)header, length);
+
+  uint8_t row[WINDOW_WIDTH * 3];
+  for (int y = 0; y < WINDOW_HEIGHT; y++) {
+    for (int x = 0; x < WINDOW_WIDTH; x++) {
+      uint16_t color = readPixel(x, y);
+      uint8_t r = (color >> 11) & 0x1F;
+      uint8_t g = (color >> 5) & 0x3F;
+      uint8_t b = color & 0x1F;
+      row[x * 3] = (r << 3) | (r >> 2);
+      row[x * 3 + 1] = (g << 2) | (g >> 4);
+      row[x * 3 + 2] = (b << 3) | (b >> 2);
+    }
+    sink(context, row, sizeof(row));
+  }
+}
+
+uint32_t RecordingDisplay::estimateSpiMicros(FrameStats stats) {
+  uint64_t bits = ((uint64_t) stats.windows * WINDOW_SETUP_BYTES + (uint64_t) stats.pixels * 2) * 8;
+  return bits * 1000000 / SPI_FREQUENCY;
+}
+
+void RecordingDisplay::record(int32_t x, int32_t y, int32_t w, int32_t h) {
+  // Clip the same way the driver does, so only pixels that reach the panel count
+  x += _xDatum;
+  y += _yDatum;
+  int32_t x1 = x + w;
+  int32_t y1 = y + h;
+  if (x < _vpX) x = _vpX;
+  if (y < _vpY) y = _vpY;
+  if (x1 > _vpW) x1 = _vpW;
+  if (y1 > _vpH) y1 = _vpH;
+  if (x1 <= x || y1 <= y) return;
+
+  frame.windows++;
+  frame.pixels += (x1 - x) * (y1 - y);
+  if (x < damageX0) damageX0 = x;
+  if (y < damageY0) damageY0 = y;
+  if (x1 > damageX1) damageX1 = x1;
+  if (y1 > damageY1) damageY1 = y1;
+}
+
+void RecordingDisplay::resetDamage() {
+  damageX0 = WINDOW_WIDTH;
+  damageY0 = WINDOW_HEIGHT;
+  damageX1 = 0;
+  damageY1 = 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <TFT_eSPI.h>
+#include "macros.h"
+
+#ifndef SPI_FREQUENCY
+#define SPI_FREQUENCY 40000000
+#endif
+
+// Bytes needed to open an address window on the ST7789: CASET and RASET with
+// their four argument bytes each, plus the RAMWR command
+#define WINDOW_SETUP_BYTES 11
+
+typedef void (*ImageSink)(void* context, const uint8_t* data, size_t length);
+
+typedef struct FrameStats {
+  uint32_t pixels;
+  uint32_t windows;
+} FrameStats;
+
+// Drop-in replacement for the TFT object that rasterizes every primitive into
+// an in-memory RGB565 framebuffer and counts what would be sent over SPI.
+// The framebuffer is mirrored to the real panel at the end of each frame.
+class RecordingDisplay : public TFT_eSprite {
+public:
+  RecordingDisplay(TFT_eSPI* panel);
+  void init();
+  void setRotation(uint8_t rotation);
+  void drawPixel(int32_t x, int32_t y, uint32_t color) override;
+  void drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size) override;
+  int16_t drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font) override;
+  int16_t drawChar(uint16_t uniCode, int32_t x, int32_t y) override;
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) override;
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) override;
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) override;
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data);
+  FrameStats endFrame();
+  FrameStats getFrameStats();
+  FrameStats getTotalStats();
+  uint32_t getFrameCount();
+  void setMirror(bool mirror);
+  // Writes the framebuffer as a binary PPM, a row at a time
+  void dumpPPM(ImageSink sink, void* context);
+  static uint32_t estimateSpiMicros(FrameStats stats);
+private:
+  TFT_eSPI* panel;
+  bool mirror;
+  int nested;
+  bool transparentText;
+  uint32_t frameCount;
+  FrameStats frame, total;
+  int32_t damageX0, damageY0, damageX1, damageY1;
+  void record(int32_t x, int32_t y, int32_t w, int32_t h);
+  void resetDamage();
+};
@@ -0,0 +1,5 @@
+#pragma once
+
+typedef struct Rect {
+  int x, y, w, h;
+} Rect;
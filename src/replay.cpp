@@ -0,0 +1,219 @@
+#include <cstring>
+#include "replay.h"
+
+ReplayRecorder::ReplayRecorder(size_t capacity):
+    ring(new uint8_t[capacity]),
+    capacity(capacity),
+    written(0),
+    keyframes(new uint64_t[capacity / REPLAY_KEYFRAME_TICKS + 1]),
+    keyframeSlots(capacity / REPLAY_KEYFRAME_TICKS + 1),
+    keyframeCount(0),
+    nextKeyframe(0),
+    ticksSinceKeyframe(0) {}
+
+ReplayRecorder::~ReplayRecorder() {
+  delete[] ring;
+  delete[] keyframes;
+}
+
+void ReplayRecorder::put8(uint8_t value) {
+  ring[written++ % capacity] = value;
+}
+
+void ReplayRecorder::put16(uint16_t value) {
+  put8(value);
+  put8(value >> 8);
+}
+
+void ReplayRecorder::put32(uint32_t value) {
+  put16(value);
+  put16(value >> 16);
+}
+
+void ReplayRecorder::keyframe(const GameState& state, TickSync& sync) {
+  keyframes[nextKeyframe] = written;
+  nextKeyframe = (nextKeyframe + 1) % keyframeSlots;
+  if (keyframeCount < keyframeSlots) keyframeCount++;
+  ticksSinceKeyframe = 0;
+
+  put8(REPLAY_KEYFRAME);
+  put32(state.tick);
+  put32(state.rng);
+  put32(state.ball.x);
+  put32(state.ball.y);
+  put32(state.ball.xSpeed);
+  put32(state.ball.ySpeed);
+  for (int i = 0; i < PADDLE_COUNT; i++) put32(state.paddles[i].pos);
+  for (int i = 0; i < PADDLE_COUNT; i++) put32(state.scores[i]);
+  put8(sync.getIsHost());
+  put32(sync.getLastRemoteTick());
+}
+
+void ReplayRecorder::remote(const RemoteTick& tick, uint16_t age) {
+  put8(REPLAY_REMOTE);
+  put16(age);
+  put32(tick.tickCount);
+  put8(tick.scored);
+  put16(tick.playerPos);
+  put32(tick.ballX);
+  put32(tick.ballY);
+  put32(tick.ballSpeedX);
+  put32(tick.ballSpeedY);
+  for (int i = 0; i < PADDLE_COUNT; i++) put16(tick.scores[i]);
+}
+
+void ReplayRecorder::point(int player) {
+  put8(REPLAY_POINT);
+  put8(player);
+}
+
+void ReplayRecorder::tick(const Inputs& local, const GameState& state, TickSync& sync) {
+  int32_t up = local.moves[UP_PADDLE];
+  int32_t down = local.moves[DOWN_PADDLE];
+  if (up == 0 && down >= -8 && down < 8) {
+    put8(REPLAY_TICK | (down & 0x0F));
+  } else {
+    put8(REPLAY_MOVES);
+    put8(up);
+    put8(down);
+  }
+
+  ticksSinceKeyframe++;
+  // Checked before a keyframe too, which would otherwise hide a divergence
+  if (ticksSinceKeyframe % REPLAY_HASH_TICKS == 0) {
+    put8(REPLAY_HASH);
+    put32(hashState(state));
+  }
+  if (ticksSinceKeyframe >= REPLAY_KEYFRAME_TICKS) keyframe(state, sync);
+}
+
+size_t ReplayRecorder::flush(ReplaySink sink, void* context) {
+  // Keyframes are in write order, the first one not overwritten yet is the
+  // oldest that can be replayed from
+  uint64_t start = written;
+  for (int i = 0; i < keyframeCount; i++) {
+    uint64_t offset = keyframes[(nextKeyframe - keyframeCount + i + keyframeSlots) % keyframeSlots];
+    if (written - offset <= capacity) {
+      start = offset;
+      break;
+    }
+  }
+
+  uint8_t header[5] = {REPLAY_MAGIC[0], REPLAY_MAGIC[1], REPLAY_MAGIC[2], REPLAY_MAGIC[3], REPLAY_VERSION};
+  sink(context, header, sizeof(header));
+  size_t length = sizeof(header);
+  while (start < written) {
+    // At most up to the end of the ring at a time
+    size_t from = start % capacity;
+    size_t chunk = written - start;
+    if (chunk > capacity - from) chunk = capacity - from;
+    sink(context, ring + from, chunk);
+    start += chunk;
+    length += chunk;
+  }
+  return length;
+}
+
+// Bounds checked little endian reads, a short read marks the cursor failed
+typedef struct ReplayCursor {
+  const uint8_t* data;
+  size_t length;
+  size_t offset;
+  bool failed;
+} ReplayCursor;
+
+static uint32_t take(ReplayCursor& cursor, int bytes) {
+  if (cursor.offset + bytes > cursor.length) {
+    cursor.failed = true;
+    cursor.offset = cursor.length;
+    return 0;
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; i++) value |= (uint32_t) cursor.data[cursor.offset++] << (8 * i);
+  return value;
+}
+
+ReplayResult runReplay(const uint8_t* data, size_t length) {
+  ReplayResult result = {};
+  ReplayCursor cursor = {data, length, 0, false};
+  if (length < 5 || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[4] != REPLAY_VERSION) return result;
+  cursor.offset = 5;
+
+  GameState& state = result.state;
+  TickSync sync;
+  bool started = false;
+  bool hasRemote = false;
+  RemoteTick remote = {};
+  while (cursor.offset < cursor.length && !cursor.failed) {
+    uint8_t opcode = take(cursor, 1);
+    if (opcode != REPLAY_KEYFRAME && !started) return result;
+
+    Inputs inputs = {{0, 0}};
+    if (opcode & REPLAY_TICK) {
+      // Sign extends the nibble
+      inputs.moves[DOWN_PADDLE] = (int8_t) (opcode << 4) >> 4;
+    } else if (opcode == REPLAY_MOVES) {
+      inputs.moves[UP_PADDLE] = (int8_t) take(cursor, 1);
+      inputs.moves[DOWN_PADDLE] = (int8_t) take(cursor, 1);
+    } else {
+      switch (opcode) {
+        case REPLAY_KEYFRAME: {
+          state.tick = take(cursor, 4);
+          state.rng = take(cursor, 4);
+          state.ball.x = take(cursor, 4);
+          state.ball.y = take(cursor, 4);
+          state.ball.xSpeed = take(cursor, 4);
+          state.ball.ySpeed = take(cursor, 4);
+          for (int i = 0; i < PADDLE_COUNT; i++) state.paddles[i].pos = take(cursor, 4);
+          for (int i = 0; i < PADDLE_COUNT; i++) state.scores[i] = take(cursor, 4);
+          bool isHost = take(cursor, 1);
+          sync.reset(isHost, (int32_t) take(cursor, 4));
+          started = true;
+          break;
+        }
+        case REPLAY_REMOTE:
+          take(cursor, 2);
+          remote.tickCount = take(cursor, 4);
+          remote.scored = (int8_t) take(cursor, 1);
+          remote.playerPos = (int16_t) take(cursor, 2);
+          remote.ballX = take(cursor, 4);
+          remote.ballY = take(cursor, 4);
+          remote.ballSpeedX = take(cursor, 4);
+          remote.ballSpeedY = take(cursor, 4);
+          for (int i = 0; i < PADDLE_COUNT; i++) remote.scores[i] = (int16_t) take(cursor, 2);
+          hasRemote = true;
+          break;
+        case REPLAY_POINT:
+          sync.scorePoint(state, (int8_t) take(cursor, 1));
+          break;
+        case REPLAY_HASH: {
+          uint32_t hash = take(cursor, 4);
+          if (cursor.failed) break;
+          result.hashesChecked++;
+          if (hash != hashState(state)) {
+            if (!result.mismatches) result.firstMismatch = state.tick;
+            result.mismatches++;
+          }
+          break;
+        }
+        default:
+          return result;
+      }
+      continue;
+    }
+    if (cursor.failed) break;
+
+    // The same order as Game::tick()
+    if (hasRemote) {
+      SyncResult synced = sync.apply(state, remote);
+      inputs.moves[UP_PADDLE] = synced.remoteMove;
+      result.remoteTicks++;
+      result.corrections += synced.corrections;
+      hasRemote = false;
+    }
+    step(state, inputs);
+    result.ticks++;
+  }
+  result.valid = started && !cursor.failed;
+  return result;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "simulation.h"
+#include "sync.h"
+
+// Bytes of recording kept in RAM. A single player tick takes one byte and a
+// multiplayer tick about 31, so this holds minutes of single player and
+// around 15 seconds of multiplayer.
+#ifndef REPLAY_RING_SIZE
+#define REPLAY_RING_SIZE 16384
+#endif
+// A full state is written this often, so a ring that wrapped can still be
+// replayed from the oldest one left in it
+#define REPLAY_KEYFRAME_TICKS 300
+// And a hash of the state this often in between, which a replay checks
+#define REPLAY_HASH_TICKS 30
+
+#define REPLAY_MAGIC "PRPL"
+#define REPLAY_VERSION 3
+
+// A recording is the magic, a version byte, then records starting with a
+// keyframe. Each record is an opcode followed by little endian fields.
+enum ReplayOpcode : uint8_t {
+  // GameState word by word, then isHost (u8) and lastRemoteTick (i32)
+  REPLAY_KEYFRAME = 0x01,
+  // Age when read in ms (u16), tickCount (i32), scored (i8), playerPos (i16),
+  // the ball (4 x i32) and the scores (2 x i16), applied to the next tick
+  REPLAY_REMOTE = 0x02,
+  // Player (i8) awarded a point, served through TickSync::scorePoint()
+  REPLAY_POINT = 0x03,
+  // hashState() (u32) after the previous tick
+  REPLAY_HASH = 0x04,
+  // Up and down moves (2 x i8), then a step
+  REPLAY_MOVES = 0x05,
+  // A step where only the local paddle moved, by the signed low nibble
+  REPLAY_TICK = 0x80,
+};
+
+typedef void (*ReplaySink)(void* context, const uint8_t* data, size_t length);
+
+// Records everything that feeds the simulation into a RAM ring, cheaply
+// enough to always be on. Once the ring is full the oldest records are
+// overwritten.
+class ReplayRecorder {
+public:
+  ReplayRecorder(size_t capacity);
+  ReplayRecorder(const ReplayRecorder&) = delete;
+  ~ReplayRecorder();
+  void keyframe(const GameState& state, TickSync& sync);
+  void remote(const RemoteTick& tick, uint16_t age);
+  void point(int player);
+  // After each step, with the moves the board itself chose
+  void tick(const Inputs& local, const GameState& state, TickSync& sync);
+  // Writes the recording from the oldest keyframe still in the ring, returns
+  // its size
+  size_t flush(ReplaySink sink, void* context);
+private:
+  uint8_t* ring;
+  size_t capacity;
+  // Bytes ever written, so older offsets can be told apart once overwritten
+  uint64_t written;
+  // Offsets of the latest keyframes. Ticks take at least a byte each, so a
+  // slot per REPLAY_KEYFRAME_TICKS bytes covers a whole ring of them.
+  uint64_t* keyframes;
+  int keyframeSlots, keyframeCount, nextKeyframe;
+  uint32_t ticksSinceKeyframe;
+
+  void put8(uint8_t value);
+  void put16(uint16_t value);
+  void put32(uint32_t value);
+};
+
+typedef struct ReplayResult {
+  // False when the recording is truncated or not a recording
+  bool valid;
+  uint32_t ticks;
+  uint32_t remoteTicks;
+  uint32_t corrections;
+  uint32_t hashesChecked;
+  uint32_t mismatches;
+  // Tick of the first hash that didn't match, 0 if none
+  uint32_t firstMismatch;
+  GameState state;
+} ReplayResult;
+
+// Plays a recording back through the same step() and TickSync the game
+// used, checking the state against every hash recorded along the way
+ReplayResult runReplay(const uint8_t* data, size_t length);
@@ -0,0 +1,46 @@
+// Replays recordings on the host, e.g. dumped over serial with 'r' and saved
+// by logdecode, or saved to flash with 'f', and checks every state hash in
+// them:
+//   .pio/build/replay/program recording.bin...
+#ifndef ARDUINO
+
+#include <cstdio>
+#include <vector>
+#include "replay.h"
+
+typedef std::vector<uint8_t> Recording;
+
+static bool readRecording(const char* path, Recording& recording) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  uint8_t chunk[4096];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) recording.insert(recording.end(), chunk, chunk + read);
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("Usage: %s recording...\n", argv[0]);
+    return 1;
+  }
+  int failed = 0;
+  for (int i = 1; i < argc; i++) {
+    Recording recording;
+    if (!readRecording(argv[i], recording)) {
+      printf("Failed to read %s\n", argv[i]);
+      return 1;
+    }
+    ReplayResult result = runReplay(recording.data(), recording.size());
+    failed += !result.valid || result.mismatches;
+    printf("%s: %s, %u ticks, %u remote, %u corrections, %u/%u hashes mismatched",
+           argv[i], result.valid ? "valid" : "invalid", result.ticks,
+           result.remoteTicks, result.corrections, result.mismatches, result.hashesChecked);
+    if (result.mismatches) printf(", first at tick %u", result.firstMismatch);
+    printf("\n");
+  }
+  return failed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include <cstdlib>
+#include "simulation.h"
+
+enum class Impact {
+  NONE,
+  WALL,
+  PADDLE,
+};
+
+static fixed_t clampSpeed(fixed_t speed, fixed_t max) {
+  if (speed < -max) return -max;
+  if (speed > max) return max;
+  return speed;
+}
+
+void initState(GameState& state, uint32_t seed) {
+  state = {};
+  // xorshift never leaves 0
+  state.rng = seed ? seed : 1;
+  state.ball.x = toFixed(Board::centerX);
+  state.ball.y = toFixed(Board::centerY);
+  // The ball stays still until the first game is started
+  state.ball.xSpeed = 0;
+  state.ball.ySpeed = 0;
+  centralizePaddles(state);
+}
+
+static uint32_t nextRandomBits(GameState& state) {
+  uint32_t x = state.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state.rng = x;
+  return x;
+}
+
+int32_t nextRandom(GameState& state, int32_t min, int32_t max) {
+  return min + (int32_t) (nextRandomBits(state) % (uint32_t) (max - min));
+}
+
+void setPaddlePos(GameState& state, PaddleSlot slot, int32_t pos) {
+  if (pos - Board::paddleHalfWidth < 0) pos = Board::paddleHalfWidth;
+  else if (pos + Board::paddleHalfWidth > Board::width) pos = Board::width - Board::paddleHalfWidth - 1;
+  state.paddles[slot].pos = pos;
+}
+
+Rect paddleBounds(PaddleSlot slot, const PaddleState& paddle) {
+  int y = slot == DOWN_PADDLE ? Board::height - Board::paddleHeight : 0;
+  return {paddle.pos - Board::paddleHalfWidth, y, Board::paddleWidth, Board::paddleHeight};
+}
+
+// Times are fractions of a tick in Q8.8
+static Impact findImpact(const GameState& state, PaddleSlot slot, fixed_t& time) {
+  const BallState& ball = state.ball;
+  const fixed_t half = Board::ballHalfSize;
+  Impact impact = Impact::NONE;
+
+  if (ball.xSpeed != 0) {
+    fixed_t wallDistance = ball.xSpeed < 0 ?
+        ball.x - half :
+        toFixed(Board::width) - (ball.x + half);
+    // Already past the wall, e.g. after rounding, reflects right away
+    fixed_t wallTime = wallDistance <= 0 ? 0 : wallDistance * FIXED_ONE / abs(ball.xSpeed);
+    if (wallTime <= time) {
+      time = wallTime;
+      impact = Impact::WALL;
+    }
+  }
+
+  if ((slot == DOWN_PADDLE) != (ball.ySpeed > 0) || ball.ySpeed == 0) return impact;
+  Rect bounds = paddleBounds(slot, state.paddles[slot]);
+  // Only the face looking at the field is hit, a ball already past it is lost
+  fixed_t faceDistance = ball.ySpeed > 0 ?
+      toFixed(bounds.y) - (ball.y + half) :
+      (ball.y - half) - toFixed(bounds.y + bounds.h);
+  if (faceDistance < 0) return impact;
+  fixed_t faceTime = faceDistance * FIXED_ONE / abs(ball.ySpeed);
+  if (faceTime > time) return impact;
+
+  fixed_t hitX = ball.x + ball.xSpeed * faceTime / FIXED_ONE;
+  if (hitX + half < toFixed(bounds.x) || hitX - half > toFixed(bounds.x + bounds.w)) return impact;
+  time = faceTime;
+  return Impact::PADDLE;
+}
+
+static void advanceBall(BallState& ball, fixed_t time) {
+  ball.x += ball.xSpeed * time / FIXED_ONE;
+  ball.y += ball.ySpeed * time / FIXED_ONE;
+}
+
+static void bounceBall(BallState& ball, const PaddleState& paddle) {
+  // The further from the center the paddle is hit, the shallower the ball leaves
+  fixed_t xSpeed = (fixed_t) (fromFixed(ball.x) - paddle.pos) * Board::ballMaxXSpeed / Board::paddleHalfWidth;
+  ball.xSpeed = clampSpeed(xSpeed, Board::ballMaxXSpeed);
+  // Every hit of a rally speeds the ball up a little
+  fixed_t speed = abs(ball.ySpeed) + BALL_ACCELERATION;
+  if (speed > Board::ballMaxSpeed) speed = Board::ballMaxSpeed;
+  ball.ySpeed = ball.ySpeed > 0 ? -speed : speed;
+}
+
+int step(GameState& state, const Inputs& inputs) {
+  for (int i = 0; i < PADDLE_COUNT; i++) {
+    if (inputs.moves[i]) setPaddlePos(state, (PaddleSlot) i, state.paddles[i].pos + inputs.moves[i]);
+  }
+
+  BallState& ball = state.ball;
+  int y = fromFixed(ball.y);
+  int scored = 0;
+  if (y - Board::ballSize >= Board::height) scored = -1;
+  else if (y + Board::ballSize <= 0) scored = 1;
+  state.tick++;
+  if (scored) return scored;
+
+  // Sweeps the ball along its path for the whole tick, reflecting it at the
+  // exact time it touches a side wall or the face of the paddle it moves
+  // towards, so it can't skip through either however fast it goes. Only the
+  // paddle the ball is heading to can be hit within a tick.
+  PaddleSlot slot = ball.ySpeed > 0 ? DOWN_PADDLE : UP_PADDLE;
+  fixed_t remaining = FIXED_ONE;
+  for (int i = 0; i < MAX_IMPACTS && remaining > 0; i++) {
+    fixed_t time = remaining;
+    Impact impact = findImpact(state, slot, time);
+    advanceBall(ball, time);
+    remaining -= time;
+    if (impact == Impact::WALL) {
+      ball.xSpeed = -ball.xSpeed;
+    } else if (impact == Impact::PADDLE) {
+      bounceBall(ball, state.paddles[slot]);
+    } else {
+      break;
+    }
+  }
+  return 0;
+}
+
+void recenterBall(GameState& state) {
+  BallState& ball = state.ball;
+  ball.x = toFixed(Board::centerX);
+  ball.y = toFixed(Board::centerY);
+  ball.xSpeed = nextRandom(state, -Board::ballMaxXSpeed, Board::ballMaxXSpeed + 1);
+  ball.ySpeed = nextRandom(state, 0, 2) ? Board::ballSpeed : -Board::ballSpeed;
+}
+
+void centralizePaddles(GameState& state) {
+  for (int i = 0; i < PADDLE_COUNT; i++) state.paddles[i].pos = Board::centerX;
+}
+
+void scorePoint(GameState& state, int player) {
+  if (player < 0) state.scores[UP_PADDLE]++;
+  else if (player > 0) state.scores[DOWN_PADDLE]++;
+  recenterBall(state);
+  centralizePaddles(state);
+}
+
+void resetMatch(GameState& state) {
+  state.tick = 0;
+  state.scores[UP_PADDLE] = 0;
+  state.scores[DOWN_PADDLE] = 0;
+  centralizePaddles(state);
+  recenterBall(state);
+}
+
+uint32_t hashState(const GameState& state) {
+  // FNV-1a over the fields in a fixed byte order, so both boards agree
+  const int32_t fields[] = {
+    (int32_t) state.tick, (int32_t) state.rng,
+    state.ball.x, state.ball.y, state.ball.xSpeed, state.ball.ySpeed,
+    state.paddles[UP_PADDLE].pos, state.paddles[DOWN_PADDLE].pos,
+    state.scores[UP_PADDLE], state.scores[DOWN_PADDLE],
+  };
+  uint32_t hash = 2166136261u;
+  for (int32_t field : fields) {
+    for (int i = 0; i < 4; i++) {
+      hash ^= (uint8_t) ((uint32_t) field >> (i * 8));
+      hash *= 16777619u;
+    }
+  }
+  return hash;
+}
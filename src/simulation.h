@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include "board.h"
+#include "fixed.h"
+#include "macros.h"
+#include "rect.h"
+
+// The game rules, kept free of any hardware or Arduino dependency so they can
+// be stepped, snapshotted and replayed anywhere. Everything that affects the
+// outcome of a match lives in GameState, and the same state stepped with the
+// same inputs always ends up in the same state.
+
+// Field, paddle and ball sizes and speeds come from the board profile
+
+// Added to the vertical speed on every paddle hit of a rally
+#ifndef BALL_ACCELERATION
+#define BALL_ACCELERATION (FIXED_ONE / 16)
+#endif
+// Bounces resolved within a single tick, e.g. a wall right after a paddle
+#define MAX_IMPACTS 4
+
+enum PaddleSlot : uint8_t {
+  UP_PADDLE,
+  DOWN_PADDLE,
+  PADDLE_COUNT
+};
+
+typedef struct BallState {
+  fixed_t x, y;
+  fixed_t xSpeed, ySpeed;
+} BallState;
+
+typedef struct PaddleState {
+  int32_t pos; // Center, in pixels
+} PaddleState;
+
+// Only 32 bit fields, so there is no padding and a snapshot is a plain copy
+typedef struct GameState {
+  uint32_t tick;
+  uint32_t rng;
+  BallState ball;
+  PaddleState paddles[PADDLE_COUNT];
+  int32_t scores[PADDLE_COUNT];
+} GameState;
+
+// How far each paddle moves this tick, in pixels
+typedef struct Inputs {
+  int32_t moves[PADDLE_COUNT];
+} Inputs;
+
+void initState(GameState& state, uint32_t seed);
+// Returns -1 when the ball left the bottom of the field, 1 when it left the
+// top and 0 otherwise
+int step(GameState& state, const Inputs& inputs);
+void scorePoint(GameState& state, int player);
+void resetMatch(GameState& state);
+void recenterBall(GameState& state);
+void centralizePaddles(GameState& state);
+void setPaddlePos(GameState& state, PaddleSlot slot, int32_t pos);
+Rect paddleBounds(PaddleSlot slot, const PaddleState& paddle);
+uint32_t hashState(const GameState& state);
+// Deterministic xorshift32, drawn from the state so it replays with it
+int32_t nextRandom(GameState& state, int32_t min, int32_t max);
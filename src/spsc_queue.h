@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single producer, single consumer ring that neither side ever blocks on,
+// e.g. filled from an interrupt or the Wi-Fi task and drained by the loop.
+// When it's full new items are dropped and counted.
+template <typename T, size_t N>
+class SpscQueue {
+public:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "The size has to be a power of two");
+
+  SpscQueue(): head(0), tail(0), dropped(0) {}
+
+  // In IRAM, so it can be pushed to from interrupts
+  bool IRAM_ATTR push(const T& item) {
+    uint32_t at = head.load(std::memory_order_relaxed);
+    if (at - tail.load(std::memory_order_acquire) == N) {
+      dropped++;
+      return false;
+    }
+    items[at % N] = item;
+    head.store(at + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    uint32_t at = tail.load(std::memory_order_relaxed);
+    if (at == head.load(std::memory_order_acquire)) return false;
+    item = items[at % N];
+    tail.store(at + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t getDropped() {
+    return dropped;
+  }
+private:
+  T items[N];
+  std::atomic<uint32_t> head, tail;
+  volatile uint32_t dropped;
+};
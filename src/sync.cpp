@@ -0,0 +1,98 @@
+#include "sync.h"
+
+TickSync::TickSync():
+    isHost(true),
+    lastRemoteTick(0) {}
+
+void TickSync::reset(bool isHost, int lastRemoteTick) {
+  this->isHost = isHost;
+  this->lastRemoteTick = lastRemoteTick;
+}
+
+// The host's serve, as the joiner sees it
+static void mirrorServe(GameState& state) {
+  BallState& ball = state.ball;
+  ball.x = toFixed(WINDOW_WIDTH) - ball.x;
+  ball.y = toFixed(WINDOW_HEIGHT) - ball.y;
+  ball.xSpeed = -ball.xSpeed;
+  ball.ySpeed = -ball.ySpeed;
+}
+
+void TickSync::resetMatch(GameState& state) {
+  ::resetMatch(state);
+  if (!isHost) mirrorServe(state);
+}
+
+void TickSync::scorePoint(GameState& state, int player) {
+  ::scorePoint(state, player);
+  if (!isHost) mirrorServe(state);
+}
+
+bool TickSync::getIsHost() {
+  return isHost;
+}
+
+int TickSync::getLastRemoteTick() {
+  return lastRemoteTick;
+}
+
+RemoteTick TickSync::makeTick(const GameState& state, int scored) {
+  RemoteTick tick = {};
+  tick.tickCount = state.tick;
+  tick.scored = scored;
+  tick.playerPos = state.paddles[DOWN_PADDLE].pos;
+  tick.ballX = state.ball.x;
+  tick.ballY = state.ball.y;
+  tick.ballSpeedX = state.ball.xSpeed;
+  tick.ballSpeedY = state.ball.ySpeed;
+  for (int i = 0; i < PADDLE_COUNT; i++) tick.scores[i] = state.scores[i];
+  return tick;
+}
+
+SyncResult TickSync::apply(GameState& state, const RemoteTick& remote) {
+  SyncResult result = {false, 0, 0, 0};
+  if (remote.tickCount <= lastRemoteTick) return result;
+  lastRemoteTick = remote.tickCount;
+  result.fresh = true;
+  // The remote paddle moves to wherever the other board has it
+  result.remoteMove = WINDOW_WIDTH - remote.playerPos - state.paddles[UP_PADDLE].pos;
+
+  if (isHost) return result;
+
+  // Points whose tick was lost on the way, made up for so the serves keep
+  // drawing from the same place
+  while (state.scores[DOWN_PADDLE] < remote.scores[UP_PADDLE]) scorePoint(state, 1);
+  while (state.scores[UP_PADDLE] < remote.scores[DOWN_PADDLE]) scorePoint(state, -1);
+
+  GameState host = state;
+  host.tick = remote.tickCount;
+  host.ball = {
+    toFixed(WINDOW_WIDTH) - remote.ballX,
+    toFixed(WINDOW_HEIGHT) - remote.ballY,
+    -remote.ballSpeedX,
+    -remote.ballSpeedY,
+  };
+  if (remote.scored) {
+    // Scored from here too, and the step of this tick brings the count back
+    // to the host's
+    result.scored = -remote.scored;
+    state.tick = remote.tickCount - 1;
+  } else if (host.tick < state.tick) {
+    // Sent a few ticks back, the ball is stepped on with the paddles where
+    // they are now
+    const Inputs still = {{0, 0}};
+    while (host.tick < state.tick && !step(host, still)) {}
+  } else {
+    // Behind the host, which keeps the clock
+    state.tick = remote.tickCount;
+  }
+
+  const fixed_t target[] = {host.ball.x, host.ball.y, host.ball.xSpeed, host.ball.ySpeed};
+  fixed_t* ball[] = {&state.ball.x, &state.ball.y, &state.ball.xSpeed, &state.ball.ySpeed};
+  for (int i = 0; i < 4; i++) {
+    if (*ball[i] == target[i]) continue;
+    *ball[i] = target[i];
+    result.corrections++;
+  }
+  return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include "simulation.h"
+
+// Sent to the peer after every tick, in the sender's point of view
+typedef struct RemoteTick {
+  int tickCount;
+  // What step() returned on this tick
+  int8_t scored;
+  int playerPos;
+  // Q8.8, so both boards keep the exact same subpixel state
+  fixed_t ballX;
+  fixed_t ballY;
+  fixed_t ballSpeedX;
+  fixed_t ballSpeedY;
+  int16_t scores[PADDLE_COUNT];
+  // Latency tracing, see LatencyTracer. The trace of the local move this
+  // tick carries, and the echo of the last one received from the peer with
+  // how long it was held and until it was drawn there, in ECHO_UNIT_US.
+  uint16_t trace;
+  uint16_t echoTrace;
+  uint16_t echoHold;
+  uint16_t echoDraw;
+} RemoteTick;
+
+typedef struct SyncResult {
+  // False for ticks older than one already applied
+  bool fresh;
+  // How far the remote paddle moves to match the peer
+  int32_t remoteMove;
+  // Ball fields that were out of sync and taken from the host
+  int corrections;
+  // On the joiner, the point the host scored on this tick, from this side
+  int scored;
+} SyncResult;
+
+// The lockstep protocol between two boards, kept apart from the radio so it
+// can run over any transport. Each board sees itself at the bottom, so
+// everything received is mirrored. The host owns the ball, the score and the
+// tick count: the joiner takes the ball of every fresh host tick, stepped on
+// to its own tick, and only ever scores the points the host scored. Both
+// boards are seeded alike when the join is accepted, so they draw the same
+// serves.
+class TickSync {
+public:
+  TickSync();
+  // A replay restores lastRemoteTick from its keyframe. A board on its own is
+  // its own host.
+  void reset(bool isHost, int lastRemoteTick = 0);
+  // resetMatch() and scorePoint(), with the serve mirrored on the joiner
+  void resetMatch(GameState& state);
+  void scorePoint(GameState& state, int player);
+  bool getIsHost();
+  int getLastRemoteTick();
+  RemoteTick makeTick(const GameState& state, int scored);
+  SyncResult apply(GameState& state, const RemoteTick& remote);
+private:
+  bool isHost;
+  int lastRemoteTick;
+};
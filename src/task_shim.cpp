@@ -0,0 +1,89 @@
+#include "task_shim.h"
+
+#ifdef ARDUINO
+
+#include <freertos/task.h>
+
+bool startTask(const char* name, TaskFunction function, void* context, uint32_t stackBytes, int priority, int core) {
+  return xTaskCreatePinnedToCore(function, name, stackBytes, context, priority, nullptr, core) == pdPASS;
+}
+
+TaskSignal::TaskSignal():
+    semaphore(xSemaphoreCreateBinary()) {}
+
+void TaskSignal::give() {
+  xSemaphoreGive(semaphore);
+}
+
+bool TaskSignal::take(uint32_t timeoutMs) {
+  TickType_t ticks = timeoutMs == WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+  return xSemaphoreTake(semaphore, ticks) == pdTRUE;
+}
+
+#else
+
+#include <ctime>
+
+typedef struct TaskStart {
+  TaskFunction function;
+  void* context;
+} TaskStart;
+
+static void* runTask(void* argument) {
+  TaskStart start = *static_cast<TaskStart*>(argument);
+  delete static_cast<TaskStart*>(argument);
+  start.function(start.context);
+  return nullptr;
+}
+
+// Threads get the default stack and are left to the scheduler, so only the
+// function and its context matter here
+bool startTask(const char*, TaskFunction function, void* context, uint32_t, int, int) {
+  pthread_t thread;
+  TaskStart* start = new TaskStart{function, context};
+  if (pthread_create(&thread, nullptr, runTask, start) != 0) {
+    delete start;
+    return false;
+  }
+  pthread_detach(thread);
+  return true;
+}
+
+TaskSignal::TaskSignal():
+    given(false) {
+  pthread_mutex_init(&mutex, nullptr);
+  pthread_cond_init(&condition, nullptr);
+}
+
+void TaskSignal::give() {
+  pthread_mutex_lock(&mutex);
+  given = true;
+  pthread_cond_signal(&condition);
+  pthread_mutex_unlock(&mutex);
+}
+
+bool TaskSignal::take(uint32_t timeoutMs) {
+  timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  if (timeoutMs != WAIT_FOREVER) {
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+  pthread_mutex_lock(&mutex);
+  int result = 0;
+  while (!given && result == 0) {
+    result = timeoutMs == WAIT_FOREVER ?
+        pthread_cond_wait(&condition, &mutex) :
+        pthread_cond_timedwait(&condition, &mutex, &deadline);
+  }
+  bool taken = given;
+  given = false;
+  pthread_mutex_unlock(&mutex);
+  return taken;
+}
+
+#endif
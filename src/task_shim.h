@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <pthread.h>
+#endif
+
+// The FreeRTOS task and signal calls the render pipeline is built on, backed
+// by pthreads on the host so the pipeline can run and be tested there too
+
+#define WAIT_FOREVER UINT32_MAX
+
+typedef void (*TaskFunction)(void* context);
+
+// The function never returns. On the host the core and priority are ignored.
+bool startTask(const char* name, TaskFunction function, void* context, uint32_t stackBytes, int priority, int core);
+
+// Wakes a single waiting task. Gives while nobody waits are kept, but don't
+// add up, so the waiter has to look for everything that happened since.
+class TaskSignal {
+public:
+  TaskSignal();
+  TaskSignal(const TaskSignal&) = delete;
+  void give();
+  // False when the timeout passed first
+  bool take(uint32_t timeoutMs = WAIT_FOREVER);
+private:
+#ifdef ARDUINO
+  SemaphoreHandle_t semaphore;
+#else
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  bool given;
+#endif
+};
@@ -0,0 +1,72 @@
+#include "glyphs.h"
+#include "text_layout.h"
+
+TextLayout::TextLayout():
+    layoutCount(0),
+    nextLayout(0) {}
+
+const TextLines& TextLayout::wrap(std::string_view text, int maxWidth) {
+    uint32_t textHash = hash(text);
+    for (int i = 0; i < layoutCount; i++) {
+        CachedLayout& layout = layouts[i];
+        if (layout.hash == textHash && layout.length == text.size() && layout.maxWidth == maxWidth) {
+            return layout.lines;
+        }
+    }
+
+    // Replace the oldest entry, menus only cycle through a handful of texts
+    CachedLayout& layout = layouts[nextLayout];
+    nextLayout = (nextLayout + 1) % MAX_LAYOUTS;
+    if (layoutCount < MAX_LAYOUTS) layoutCount++;
+    layout.hash = textHash;
+    layout.length = text.size();
+    layout.maxWidth = maxWidth;
+    breakLines(text, maxWidth, layout.lines);
+    return layout.lines;
+}
+
+void TextLayout::breakLines(std::string_view text, int maxWidth, TextLines& result) {
+    result.count = 0;
+    size_t lineStart = 0;
+    int lineWidth = 0;
+    // Last space in the current line, where it can be broken
+    size_t breakAt = 0;
+    int widthAtBreak = 0;
+    bool canBreak = false;
+
+    for (size_t i = 0; i < text.size() && result.count < MAX_LINES; i++) {
+        char c = text[i];
+        if (c == '\n') {
+            result.lines[result.count++] = {(uint16_t) lineStart, (uint16_t) (i - lineStart)};
+            lineStart = i + 1;
+            lineWidth = 0;
+            canBreak = false;
+            continue;
+        }
+        if (c == ' ') {
+            breakAt = i;
+            widthAtBreak = lineWidth;
+            canBreak = true;
+        }
+        lineWidth += GlyphAtlas::advance(c);
+        if (lineWidth >= maxWidth && canBreak && c != ' ') {
+            result.lines[result.count++] = {(uint16_t) lineStart, (uint16_t) (breakAt - lineStart)};
+            lineStart = breakAt + 1;
+            lineWidth -= widthAtBreak + GlyphAtlas::advance(' ');
+            canBreak = false;
+        }
+    }
+    if (lineStart < text.size() && result.count < MAX_LINES) {
+        result.lines[result.count++] = {(uint16_t) lineStart, (uint16_t) (text.size() - lineStart)};
+    }
+}
+
+uint32_t TextLayout::hash(std::string_view text) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash ^= (uint8_t) c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
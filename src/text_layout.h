@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#define MAX_LINES 12
+#define MAX_LAYOUTS 8
+
+typedef struct LineSpan {
+    uint16_t start;
+    uint16_t length;
+} LineSpan;
+
+typedef struct TextLines {
+    uint8_t count;
+    LineSpan lines[MAX_LINES];
+} TextLines;
+
+// Where a submenu is drawn, computed once by Graphics and kept until the
+// submenu's text or options change
+typedef struct MenuLayout {
+    bool valid;
+    int textY, textBottom;
+    int optionsTop, optionHeight;
+    int visibleOptions, firstVisible;
+} MenuLayout;
+
+// Word wraps text without allocating. Glyph advances come from the glyph
+// atlas, and line breaks are cached per text and width, so laying out the
+// same menu again only costs a hash of the text.
+class TextLayout {
+public:
+    TextLayout();
+    const TextLines& wrap(std::string_view text, int maxWidth);
+    static uint32_t hash(std::string_view text);
+private:
+    typedef struct CachedLayout {
+        uint32_t hash;
+        uint16_t length;
+        uint16_t maxWidth;
+        TextLines lines;
+    } CachedLayout;
+
+    CachedLayout layouts[MAX_LAYOUTS];
+    int layoutCount, nextLayout;
+
+    void breakLines(std::string_view text, int maxWidth, TextLines& result);
+};
@@ -0,0 +1,67 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "trace_log.h"
+
+TraceLog traceLog;
+
+TraceLog::TraceLog():
+    records{},
+    head(0),
+    tail(0),
+    sequence(0),
+    dropped(0),
+    reportedDropped(0),
+    lock(portMUX_INITIALIZER_UNLOCKED) {}
+
+void TraceLog::begin() {
+  // Core 0 with the Wi-Fi task, just above idle, so it only ever sends what
+  // the loop and the radio leave time for
+  xTaskCreatePinnedToCore(TraceLog::drain, "trace_log", 2048, this, 1, nullptr, 0);
+}
+
+void IRAM_ATTR TraceLog::write(LogEvent event, int32_t a, int32_t b, int32_t c, int32_t d) {
+  uint32_t time = micros();
+  portENTER_CRITICAL_SAFE(&lock);
+  // Numbered even when dropped, so the gap shows where
+  uint16_t number = sequence++;
+  if (head - tail == LOG_RING_RECORDS) {
+    dropped++;
+  } else {
+    records[head % LOG_RING_RECORDS] = {time, event, number, {a, b, c, d}};
+    head++;
+  }
+  portEXIT_CRITICAL_SAFE(&lock);
+}
+
+bool TraceLog::read(LogRecord& record) {
+  portENTER_CRITICAL(&lock);
+  bool available = head != tail;
+  if (available) record = records[tail++ % LOG_RING_RECORDS];
+  portEXIT_CRITICAL(&lock);
+  return available;
+}
+
+uint32_t TraceLog::getDropped() {
+  return dropped;
+}
+
+void TraceLog::drain(void* context) {
+  TraceLog* log = static_cast<TraceLog*>(context);
+  uint8_t frame[2 + sizeof(LogRecord)] = {LOG_SYNC_0, LOG_SYNC_1};
+  LogRecord record;
+  for (;;) {
+    if (log->read(record)) {
+      memcpy(frame + 2, &record, sizeof(LogRecord));
+      Serial.write(frame, sizeof(frame));
+      continue;
+    }
+    // Reported once the ring has room again
+    uint32_t dropped = log->dropped;
+    if (dropped != log->reportedDropped) {
+      logEvent<LOG_DROPPED>(dropped - log->reportedDropped);
+      log->reportedDropped = dropped;
+      continue;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+  }
+}
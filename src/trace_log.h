@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+#include "log_events.h"
+
+// Events above this level are compiled out entirely
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+// Records kept until the drain task sends them
+#define LOG_RING_RECORDS 256
+// How long the drain task sleeps once the ring is empty
+#define LOG_DRAIN_MS 10
+
+// Fixed size binary records in a RAM ring, cheap enough to write from the
+// tick and from the Wi-Fi callbacks. A low priority task drains them to
+// Serial, and the logdecode host tool turns them back into text. When the
+// ring is full new records are dropped and counted.
+class TraceLog {
+public:
+  TraceLog();
+  // Starts the drain task
+  void begin();
+  // Safe from any task or interrupt
+  void write(LogEvent event, int32_t a, int32_t b, int32_t c, int32_t d);
+  bool read(LogRecord& record);
+  uint32_t getDropped();
+private:
+  LogRecord records[LOG_RING_RECORDS];
+  uint32_t head, tail;
+  uint16_t sequence;
+  uint32_t dropped, reportedDropped;
+  portMUX_TYPE lock;
+
+  static void drain(void* context);
+};
+
+extern TraceLog traceLog;
+
+template <LogEvent event>
+inline void logEvent(int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0) {
+  if constexpr (logLevels[event] <= LOG_LEVEL) traceLog.write(event, a, b, c, d);
+}
+
+// A MAC takes two arguments, read back by %M
+inline int32_t macHigh(const uint8_t* mac) {
+  return (int32_t) ((uint32_t) mac[0] << 24 | mac[1] << 16 | mac[2] << 8 | mac[3]);
+}
+
+inline int32_t macLow(const uint8_t* mac) {
+  return mac[4] << 8 | mac[5];
+}
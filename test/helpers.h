@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include "simulation.h"
+
+// Shared by the host test suites, so they all roll the same dice and field
+// the same opponent.
+
+// Deterministic xorshift32, never pass it a state of 0
+inline uint32_t xorshift(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Moves the paddle in slot towards the ball as fast as it can, the same
+// opponent as MatchBatch::track()
+inline int32_t trackBall(const GameState& state, PaddleSlot slot) {
+  int32_t move = fromFixed(state.ball.x) - state.paddles[slot].pos;
+  if (move > Board::paddleSpeed) return Board::paddleSpeed;
+  if (move < -Board::paddleSpeed) return -Board::paddleSpeed;
+  return move;
+}
+
+// Like trackBall(), but stands still one tick in missOneIn, so points still
+// get scored
+inline int32_t followBall(const GameState& state, PaddleSlot slot, uint32_t& rng, uint32_t missOneIn) {
+  if (xorshift(rng) % missOneIn == 0) return 0;
+  return trackBall(state, slot);
+}
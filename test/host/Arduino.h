@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Host stand-in for the few Arduino pieces the display code uses, so
+// RecordingDisplay and the Compositor build in the native tests. Serial goes
+// to stdout.
+
+using std::max;
+using std::min;
+
+class HostSerial {
+public:
+  void println(const char* text) {
+    puts(text);
+  }
+
+  int printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vprintf(format, args);
+    va_end(args);
+    return length;
+  }
+};
+
+inline HostSerial Serial;
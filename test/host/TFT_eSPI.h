@@ -0,0 +1,182 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstdlib>
+
+// Host stand-in for the parts of TFT_eSPI that RecordingDisplay and the
+// Compositor use. The panel draws nothing, sprites keep an RGB565
+// framebuffer and follow the library's viewport and datum rules, which is
+// all RecordingDisplay counts with. Text isn't rasterized, a glyph drawn
+// with a background only fills its cell.
+class TFT_eSPI {
+public:
+  TFT_eSPI(int16_t width = 0, int16_t height = 0):
+      textcolor(0), textbgcolor(0), textfont(1), textsize(1), _width(width), _height(height) {
+    resetViewport();
+  }
+
+  virtual ~TFT_eSPI() {}
+
+  void init(uint8_t = 0) {}
+  void setRotation(uint8_t) {}
+
+  virtual void drawPixel(int32_t, int32_t, uint32_t) {}
+  virtual void drawChar(int32_t, int32_t, uint16_t, uint32_t, uint32_t, uint8_t) {}
+  virtual int16_t drawChar(uint16_t, int32_t, int32_t, uint8_t) {
+    return 6;
+  }
+  virtual int16_t drawChar(uint16_t, int32_t, int32_t) {
+    return 6;
+  }
+  virtual void drawFastVLine(int32_t, int32_t, int32_t, uint32_t) {}
+  virtual void drawFastHLine(int32_t, int32_t, int32_t, uint32_t) {}
+  virtual void fillRect(int32_t, int32_t, int32_t, int32_t, uint32_t) {}
+  virtual uint16_t readPixel(int32_t, int32_t) {
+    return 0;
+  }
+
+  void fillScreen(uint32_t color) {
+    fillRect(0, 0, _width, _height, color);
+  }
+
+  void pushImage(int32_t, int32_t, int32_t, int32_t, uint16_t*) {}
+  void pushImageDMA(int32_t, int32_t, int32_t, int32_t, uint16_t*, uint16_t* = nullptr) {}
+  bool initDMA(bool = false) {
+    return false;
+  }
+  void deInitDMA() {}
+  void dmaWait() {}
+  void startWrite() {}
+  void endWrite() {}
+
+  // Same as the library: the viewport is clipped to the screen, and drawing
+  // is relative to its corner only with vpDatum
+  void setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool vpDatum = true) {
+    _xDatum = x;
+    _yDatum = y;
+    _vpX = max<int32_t>(x, 0);
+    _vpY = max<int32_t>(y, 0);
+    _vpW = min<int32_t>(x + w, _width);
+    _vpH = min<int32_t>(y + h, _height);
+    _vpOoB = _vpX >= _vpW || _vpY >= _vpH;
+    if (!vpDatum) {
+      _xDatum = 0;
+      _yDatum = 0;
+    }
+  }
+
+  void resetViewport() {
+    _xDatum = 0;
+    _yDatum = 0;
+    _vpX = 0;
+    _vpY = 0;
+    _vpW = _width;
+    _vpH = _height;
+    _vpOoB = false;
+  }
+
+  int16_t fontHeight(int16_t = 1) {
+    return 8 * textsize;
+  }
+
+  uint32_t textcolor, textbgcolor;
+  uint8_t textfont, textsize;
+protected:
+  int32_t _width, _height;
+  int32_t _vpX, _vpY, _vpW, _vpH;
+  int32_t _xDatum, _yDatum;
+  bool _vpOoB;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+public:
+  explicit TFT_eSprite(TFT_eSPI*): buffer(nullptr) {}
+
+  ~TFT_eSprite() {
+    deleteSprite();
+  }
+
+  // Only 16 bit sprites
+  void setColorDepth(int8_t) {}
+
+  void* createSprite(int16_t width, int16_t height, uint8_t = 1) {
+    deleteSprite();
+    buffer = static_cast<uint16_t*>(calloc((size_t) width * height, sizeof(uint16_t)));
+    _width = buffer ? width : 0;
+    _height = buffer ? height : 0;
+    resetViewport();
+    return buffer;
+  }
+
+  void deleteSprite() {
+    free(buffer);
+    buffer = nullptr;
+    _width = 0;
+    _height = 0;
+  }
+
+  void* getPointer() {
+    return buffer;
+  }
+
+  bool pushSprite(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t) {
+    return true;
+  }
+
+  void drawPixel(int32_t x, int32_t y, uint32_t color) override {
+    fill(x, y, 1, 1, color);
+  }
+
+  void drawChar(int32_t x, int32_t y, uint16_t, uint32_t color, uint32_t bg, uint8_t size) override {
+    if (color != bg) fill(x, y, 6 * size, 8 * size, bg);
+  }
+
+  int16_t drawChar(uint16_t, int32_t x, int32_t y, uint8_t font) override {
+    if (textcolor != textbgcolor) fill(x, y, 6 * textsize, fontHeight(font), textbgcolor);
+    return 6 * textsize;
+  }
+
+  int16_t drawChar(uint16_t uniCode, int32_t x, int32_t y) override {
+    return drawChar(uniCode, x, y, textfont);
+  }
+
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) override {
+    fill(x, y, 1, h, color);
+  }
+
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) override {
+    fill(x, y, w, 1, color);
+  }
+
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) override {
+    fill(x, y, w, h, color);
+  }
+
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data) {
+    if (!buffer || _vpOoB) return;
+    for (int32_t row = 0; row < h; row++) {
+      for (int32_t column = 0; column < w; column++) {
+        int32_t px = x + column + _xDatum, py = y + row + _yDatum;
+        if (px >= _vpX && px < _vpW && py >= _vpY && py < _vpH) buffer[py * _width + px] = data[row * w + column];
+      }
+    }
+  }
+
+  uint16_t readPixel(int32_t x, int32_t y) override {
+    x += _xDatum;
+    y += _yDatum;
+    if (!buffer || x < _vpX || x >= _vpW || y < _vpY || y >= _vpH) return 0xFFFF;
+    return buffer[y * _width + x];
+  }
+private:
+  uint16_t* buffer;
+
+  void fill(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    if (!buffer || _vpOoB) return;
+    int32_t x0 = max(x + _xDatum, _vpX), y0 = max(y + _yDatum, _vpY);
+    int32_t x1 = min(x + _xDatum + w, _vpW), y1 = min(y + _yDatum + h, _vpH);
+    for (int32_t py = y0; py < y1; py++) {
+      for (int32_t px = x0; px < x1; px++) buffer[py * _width + px] = color;
+    }
+  }
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+// Host stand-in, there is no DMA capable memory, so the Compositor never
+// sizes buffers for it
+#define MALLOC_CAP_DMA (1 << 3)
+
+inline void* heap_caps_malloc(size_t size, uint32_t) {
+  return malloc(size);
+}
+
+inline void heap_caps_free(void* pointer) {
+  free(pointer);
+}
+
+inline size_t heap_caps_get_free_size(uint32_t) {
+  return 0;
+}
+
+inline size_t heap_caps_get_largest_free_block(uint32_t) {
+  return 0;
+}
@@ -0,0 +1,63 @@
+// MatchBatch has to end every match in the same state as step() does, and
+// how much faster it gets there is printed along the way.
+#include <chrono>
+#include <cstdio>
+#include <unity.h>
+#include <vector>
+#include "batch.h"
+#include "helpers.h"
+#include "simulation.h"
+
+#define BENCHMARK_MATCHES 4096
+#define BENCHMARK_TICKS 2000
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testBatchMatchesStep() {
+  MatchBatch batch(BENCHMARK_MATCHES, 1);
+  std::vector<GameState> states(BENCHMARK_MATCHES);
+  for (int i = 0; i < BENCHMARK_MATCHES; i++) states[i] = batch.getState(i);
+
+  // One state at a time through step(), as the firmware runs a match
+  auto start = std::chrono::steady_clock::now();
+  for (int tick = 0; tick < BENCHMARK_TICKS; tick++) {
+    for (GameState& state : states) {
+      Inputs inputs = {{trackBall(state, UP_PADDLE), trackBall(state, DOWN_PADDLE)}};
+      int scored = step(state, inputs);
+      if (scored) scorePoint(state, scored);
+    }
+  }
+  double scalar = secondsSince(start);
+
+  std::vector<int32_t> upMoves(BENCHMARK_MATCHES), downMoves(BENCHMARK_MATCHES);
+  start = std::chrono::steady_clock::now();
+  for (int tick = 0; tick < BENCHMARK_TICKS; tick++) {
+    batch.track(upMoves.data(), downMoves.data());
+    batch.step(upMoves.data(), downMoves.data());
+  }
+  double batched = secondsSince(start);
+
+  // Both ran the same matches, so they must have ended in the same states
+  int diverged = 0;
+  for (int i = 0; i < BENCHMARK_MATCHES; i++) {
+    if (hashState(batch.getState(i)) != hashState(states[i])) diverged++;
+  }
+
+  double steps = (double) BENCHMARK_MATCHES * BENCHMARK_TICKS;
+  printf("%d matches x %d ticks\n", BENCHMARK_MATCHES, BENCHMARK_TICKS);
+  printf("step():     %.3f s, %.1f M match-ticks/s\n", scalar, steps / scalar / 1e6);
+  printf("MatchBatch: %.3f s, %.1f M match-ticks/s (%.2fx)\n", batched, steps / batched / 1e6, scalar / batched);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, diverged, "Matches diverged from step()");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testBatchMatchesStep);
+  return UNITY_END();
+}
@@ -0,0 +1,228 @@
+// Steps the simulation at a fixed tick rate and hands its frames over a
+// DrawList to a render task started through the pthread shim, like the
+// firmware does, with frames that sometimes take several ticks to draw like
+// a busy SPI bus. Every change has to reach the screen in order, and how
+// late ticks run against drawing each frame within its tick is printed.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unity.h>
+#include <vector>
+#include "draw_list.h"
+#include "helpers.h"
+#include "simulation.h"
+#include "task_shim.h"
+
+#define PIPELINE_TICKS 1500
+#define PIPELINE_INTERVAL_US 2000
+// Most frames take a fraction of a tick, SLOW_PER_MILLE of them several
+#define FRAME_US 600
+#define SLOW_FRAME_US 7000
+#define SLOW_PER_MILLE 50
+
+enum PipelineSprite : uint8_t {
+  UP_SPRITE,
+  DOWN_SPRITE,
+  BALL_SPRITE,
+  SPRITE_COUNT
+};
+
+static uint32_t nowMicros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return (uint32_t) duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+// What the render task put on screen
+typedef struct Screen {
+  Rect sprites[SPRITE_COUNT];
+  int32_t scores[PADDLE_COUNT];
+  uint32_t frames, redraws;
+} Screen;
+
+typedef struct Pipeline {
+  DrawList drawList;
+  TaskSignal signal;
+  Screen screen;
+  uint32_t rng;
+} Pipeline;
+
+typedef struct RunReport {
+  uint32_t frames, merged, redraws;
+  uint32_t lateTicks, maxLateUs;
+  uint32_t maxFrameUs;
+  uint32_t outOfOrder;
+  bool matches;
+} RunReport;
+
+static void drawFrame(Pipeline& pipeline, const DrawFrame& frame) {
+  Screen& screen = pipeline.screen;
+  for (int i = 0; i < frame.count; i++) {
+    const DrawCommand& command = frame.commands[i];
+    switch (command.op) {
+      case DRAW_SPRITE:
+        screen.sprites[command.id] = {command.x, command.y, command.w, command.h};
+        break;
+      case DRAW_SCORE:
+        screen.scores[command.id] = command.x;
+        break;
+      case DRAW_REDRAW:
+        screen.redraws++;
+        break;
+    }
+  }
+  bool slow = xorshift(pipeline.rng) % 1000 < SLOW_PER_MILLE;
+  std::this_thread::sleep_for(std::chrono::microseconds(slow ? SLOW_FRAME_US : FRAME_US));
+  screen.frames++;
+}
+
+static void drawSubmitted(Pipeline& pipeline) {
+  const DrawFrame* frame;
+  while ((frame = pipeline.drawList.peek()) != nullptr) {
+    drawFrame(pipeline, *frame);
+    pipeline.drawList.release(nowMicros());
+  }
+}
+
+static void renderTask(void* context) {
+  Pipeline* pipeline = static_cast<Pipeline*>(context);
+  for (;;) {
+    pipeline->signal.take();
+    drawSubmitted(*pipeline);
+  }
+}
+
+// Traces are tick numbers, so drawn frames have to come back in order
+static void takeDrawn(Pipeline& pipeline, const std::vector<uint32_t>& submittedAt, uint16_t& lastTrace,
+                      RunReport& report) {
+  DrawnFrame drawn;
+  while (pipeline.drawList.takeDrawn(drawn)) {
+    if (drawn.trace <= lastTrace) report.outOfOrder++;
+    lastTrace = drawn.trace;
+    report.maxFrameUs = std::max(report.maxFrameUs, drawn.time - submittedAt[drawn.trace]);
+  }
+}
+
+static void emit(Pipeline& pipeline, const GameState& state, int32_t* drawnScores) {
+  DrawList& drawList = pipeline.drawList;
+  for (int i = 0; i < PADDLE_COUNT; i++) {
+    if (state.scores[i] == drawnScores[i]) continue;
+    drawnScores[i] = state.scores[i];
+    drawList.setScore(i, state.scores[i]);
+  }
+  drawList.moveSprite(UP_SPRITE, paddleBounds(UP_PADDLE, state.paddles[UP_PADDLE]));
+  drawList.moveSprite(DOWN_SPRITE, paddleBounds(DOWN_PADDLE, state.paddles[DOWN_PADDLE]));
+  int x = fromFixed(state.ball.x) - Board::ballSize / 2;
+  int y = fromFixed(state.ball.y) - Board::ballSize / 2;
+  drawList.moveSprite(BALL_SPRITE, {x, y, Board::ballSize, Board::ballSize});
+}
+
+static RunReport run(Pipeline& pipeline, bool threaded) {
+  RunReport report = {};
+  GameState state;
+  initState(state, 1234);
+  resetMatch(state);
+  int32_t drawnScores[PADDLE_COUNT] = {-1, -1};
+  std::vector<uint32_t> submittedAt(PIPELINE_TICKS + 1);
+  uint16_t lastTrace = 0;
+  uint32_t rng = 99;
+
+  uint32_t start = nowMicros();
+  for (uint32_t tick = 1; tick <= PIPELINE_TICKS; tick++) {
+    uint32_t due = start + tick * PIPELINE_INTERVAL_US;
+    uint32_t now = nowMicros();
+    if ((int32_t) (due - now) > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+    } else {
+      uint32_t late = now - due;
+      report.maxLateUs = std::max(report.maxLateUs, late);
+      if (late > PIPELINE_INTERVAL_US / 2) report.lateTicks++;
+    }
+    takeDrawn(pipeline, submittedAt, lastTrace, report);
+
+    // Both paddles miss often, so points and redraws come up
+    Inputs inputs = {{followBall(state, UP_PADDLE, rng, 4), followBall(state, DOWN_PADDLE, rng, 4)}};
+    int scored = step(state, inputs);
+    if (scored) {
+      scorePoint(state, scored);
+      pipeline.drawList.redraw();
+    }
+    emit(pipeline, state, drawnScores);
+    pipeline.drawList.setTrace(tick);
+    submittedAt[tick] = nowMicros();
+    if (!pipeline.drawList.submit()) {
+      report.merged++;
+      continue;
+    }
+    if (threaded) pipeline.signal.give();
+    else drawSubmitted(pipeline);
+  }
+
+  // Whatever is still pending goes out once there's room
+  while (!pipeline.drawList.submit()) {
+    takeDrawn(pipeline, submittedAt, lastTrace, report);
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  if (threaded) pipeline.signal.give();
+  else drawSubmitted(pipeline);
+  while (!pipeline.drawList.isDrained()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+  takeDrawn(pipeline, submittedAt, lastTrace, report);
+
+  const Screen& screen = pipeline.screen;
+  Rect up = paddleBounds(UP_PADDLE, state.paddles[UP_PADDLE]);
+  Rect down = paddleBounds(DOWN_PADDLE, state.paddles[DOWN_PADDLE]);
+  Rect ball = {fromFixed(state.ball.x) - Board::ballSize / 2, fromFixed(state.ball.y) - Board::ballSize / 2,
+               Board::ballSize, Board::ballSize};
+  auto same = [](Rect a, Rect b) { return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h; };
+  report.matches = same(screen.sprites[UP_SPRITE], up) && same(screen.sprites[DOWN_SPRITE], down) &&
+      same(screen.sprites[BALL_SPRITE], ball) &&
+      screen.scores[UP_PADDLE] == state.scores[UP_PADDLE] && screen.scores[DOWN_PADDLE] == state.scores[DOWN_PADDLE];
+  report.frames = screen.frames;
+  report.redraws = screen.redraws;
+  return report;
+}
+
+static void print(const char* name, const RunReport& report) {
+  printf("%-8s %u frames, %u merged, %u redraws, %u late ticks, max %u us late, max %u us to screen%s%s\n",
+         name, report.frames, report.merged, report.redraws, report.lateTicks, report.maxLateUs, report.maxFrameUs,
+         report.outOfOrder ? ", OUT OF ORDER" : "", report.matches ? "" : ", SCREEN MISMATCH");
+}
+
+static void check(const RunReport& report) {
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, report.outOfOrder, "Frames were drawn out of order");
+  TEST_ASSERT_TRUE_MESSAGE(report.matches, "The screen doesn't show the last state");
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testInlineFrames() {
+  Pipeline* pipeline = new Pipeline();
+  pipeline->rng = 7;
+  RunReport report = run(*pipeline, false);
+  print("Inline", report);
+  delete pipeline;
+  check(report);
+}
+
+static void testThreadedFrames() {
+  // Never freed, the render task keeps running until the process exits
+  Pipeline* pipeline = new Pipeline();
+  pipeline->rng = 7;
+  TEST_ASSERT_TRUE_MESSAGE(startTask("render", renderTask, pipeline, 4096, 2, 0), "Failed to start the render task");
+  RunReport report = run(*pipeline, true);
+  print("Threaded", report);
+  check(report);
+}
+
+int main() {
+  printf("%d ticks of %d us, frames of %d us, %d per mille of %d us\n",
+         PIPELINE_TICKS, PIPELINE_INTERVAL_US, FRAME_US, SLOW_PER_MILLE, SLOW_FRAME_US);
+  UNITY_BEGIN();
+  RUN_TEST(testInlineFrames);
+  RUN_TEST(testThreadedFrames);
+  return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// Renders a few playfield frames through the Compositor into a
+// RecordingDisplay, the backend the recording environment swaps in for
+// Game::tft, and checks what each frame would send over SPI and the final
+// image against reference.ppm next to this file. After a deliberate change
+// to the rendering, rerun with UPDATE_REFERENCE=1 to write the new image and
+// update the counts below.
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unity.h>
+#include <vector>
+#include "compositor.h"
+#include "recording_display.h"
+
+#define FRAME_COUNT 6
+
+// Pixels and address windows of each frame in render(). The first only
+// repaints the sprites and layers, as after Game::initialRender() clears
+// the screen, then every move sends its trailing and leading strips.
+static const FrameStats expectedFrames[FRAME_COUNT] = {
+  {780, 23},
+  {130, 8},
+  {130, 8},
+  {130, 8},
+  {132, 9},
+  {138, 9},
+};
+
+static const int scoreW = 5, scoreH = 7;
+// A 3, like the score glyphs, one bit per pixel and row
+static const uint8_t scoreRows[scoreH] = {0x1E, 0x01, 0x01, 0x0E, 0x01, 0x01, 0x1E};
+
+typedef struct Scene {
+  Compositor* compositor;
+  uint16_t score[scoreW * scoreH];
+} Scene;
+
+// The field's dashed center line, drawn like Field::render()
+static int paintField(void*, TFT_eSPI& canvas, Rect clip) {
+  int pixels = 0;
+  for (int x = 0; x < WINDOW_WIDTH; x += 8) {
+    Rect restored = Compositor::intersection({x, Board::centerY, 4, 2}, clip);
+    if (restored.w <= 0 || restored.h <= 0) continue;
+    canvas.fillRect(restored.x, restored.y, restored.w, restored.h, WHITE);
+    pixels += restored.w * restored.h;
+  }
+  return pixels;
+}
+
+static Rect scoreBounds() {
+  return {4, Board::centerY - scoreH - 4, scoreW, scoreH};
+}
+
+// Blitted like the score glyphs, so pushImage is covered too
+static int paintScore(void* context, TFT_eSPI& canvas, Rect clip) {
+  Scene* scene = static_cast<Scene*>(context);
+  Rect bounds = scoreBounds();
+  scene->compositor->blit(canvas, bounds.x, bounds.y, bounds.w, bounds.h, scene->score);
+  Rect restored = Compositor::intersection(bounds, clip);
+  return restored.w * restored.h;
+}
+
+static Rect ballAt(int x, int y) {
+  return {x - Board::ballSize / 2, y - Board::ballSize / 2, Board::ballSize, Board::ballSize};
+}
+
+// A full first frame, then the ball moving down and across the center line
+// and score while the paddles follow it
+static void render(RecordingDisplay& display, std::vector<FrameStats>& frames) {
+  Scene scene;
+  Compositor compositor(&display);
+  scene.compositor = &compositor;
+  for (int y = 0; y < scoreH; y++) {
+    for (int x = 0; x < scoreW; x++) scene.score[y * scoreW + x] = scoreRows[y] >> (scoreW - 1 - x) & 1 ? RED : BLACK;
+  }
+
+  int up = compositor.addSprite(WHITE);
+  int down = compositor.addSprite(WHITE);
+  int ball = compositor.addSprite(BLUE);
+  int field = compositor.addLayer(paintField, &scene);
+  compositor.setLayerBounds(field, {0, Board::centerY, WINDOW_WIDTH, 2});
+  int score = compositor.addLayer(paintScore, &scene);
+  compositor.setLayerBounds(score, scoreBounds());
+
+  int paddleX = Board::centerX, ballX = 20, ballY = Board::centerY - 16;
+  for (int frame = 0; frame < FRAME_COUNT; frame++) {
+    if (frame == 0) compositor.invalidate();
+    compositor.moveSprite(up, {paddleX - Board::paddleHalfWidth, 0, Board::paddleWidth, Board::paddleHeight});
+    compositor.moveSprite(down, {paddleX - Board::paddleHalfWidth, Board::height - Board::paddleHeight,
+                                 Board::paddleWidth, Board::paddleHeight});
+    compositor.moveSprite(ball, ballAt(ballX, ballY));
+    compositor.flush();
+    frames.push_back(display.endFrame());
+    ballX -= 3;
+    ballY += 5;
+    paddleX -= 2;
+  }
+}
+
+static void appendImage(void* context, const uint8_t* data, size_t length) {
+  std::vector<uint8_t>* image = static_cast<std::vector<uint8_t>*>(context);
+  image->insert(image->end(), data, data + length);
+}
+
+static std::string referencePath() {
+  std::string path = __FILE__;
+  return path.substr(0, path.find_last_of('/') + 1) + "reference.ppm";
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  uint8_t chunk[4096];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) contents.insert(contents.end(), chunk, chunk + read);
+  fclose(file);
+  return true;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testFramesMatchReference() {
+  TFT_eSPI panel;
+  RecordingDisplay display(&panel);
+  display.init();
+  display.setMirror(false);
+  std::vector<FrameStats> frames;
+  render(display, frames);
+  std::vector<uint8_t> image;
+  display.dumpPPM(appendImage, &image);
+
+  for (int i = 0; i < FRAME_COUNT; i++) {
+    printf("Frame %d: %u px, %u windows, ~%u us SPI\n", i, frames[i].pixels, frames[i].windows,
+           RecordingDisplay::estimateSpiMicros(frames[i]));
+  }
+  if (getenv("UPDATE_REFERENCE")) {
+    FILE* file = fopen(referencePath().c_str(), "wb");
+    TEST_ASSERT_TRUE_MESSAGE(file, "Can't write the reference image");
+    fwrite(image.data(), 1, image.size(), file);
+    fclose(file);
+    printf("Wrote %s\n", referencePath().c_str());
+  }
+
+  for (int i = 0; i < FRAME_COUNT; i++) {
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedFrames[i].pixels, frames[i].pixels, "Pixels sent changed");
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(expectedFrames[i].windows, frames[i].windows, "Address windows changed");
+  }
+  std::vector<uint8_t> reference;
+  TEST_ASSERT_TRUE_MESSAGE(readFile(referencePath(), reference), "Can't read reference.ppm");
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(reference.size(), image.size(), "The image size changed");
+  size_t first = 0;
+  while (first < image.size() && image[first] == reference[first]) first++;
+  if (first < image.size()) printf("First difference at byte %zu\n", first);
+  TEST_ASSERT_TRUE_MESSAGE(first == image.size(), "The image differs from reference.ppm");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testFramesMatchReference);
+  return UNITY_END();
+}
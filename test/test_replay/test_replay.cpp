@@ -0,0 +1,122 @@
+// Records a corpus of host/joiner matches the way Game::tick() records
+// them, then replays every recording, which has to match each state hash
+// without leaking or allocating. Replay throughput is printed along the way.
+#include <chrono>
+#include <cstdio>
+#include <unity.h>
+#include <vector>
+#include "heap_tracker.h"
+#include "helpers.h"
+#include "replay.h"
+#include "simulation.h"
+#include "sync.h"
+
+#define CORPUS_MATCHES 64
+#define CORPUS_TICKS 18000 // 10 minutes at 30 ticks per second
+#define CORPUS_RING_SIZE (1 << 20)
+#define BENCHMARK_ROUNDS 10
+
+typedef std::vector<uint8_t> Recording;
+
+static void appendRecording(void* context, const uint8_t* data, size_t length) {
+  Recording* recording = static_cast<Recording*>(context);
+  recording->insert(recording->end(), data, data + length);
+}
+
+// Two boards ticking in turn, each reading the tick the other sent last,
+// recorded the way Game::tick() records them
+static void recordMatch(int index, std::vector<Recording>& corpus) {
+  GameState states[2];
+  TickSync syncs[2];
+  ReplayRecorder* recorders[2];
+  RemoteTick inbox[2];
+  bool hasTick[2] = {false, false};
+  uint32_t rng = 0x9E3779B9u * (index + 1);
+  for (int i = 0; i < 2; i++) {
+    initState(states[i], rng);
+    syncs[i].reset(i == 0);
+    syncs[i].resetMatch(states[i]);
+    HeapScope scope(HEAP_REPLAY);
+    recorders[i] = new ReplayRecorder(CORPUS_RING_SIZE);
+    recorders[i]->keyframe(states[i], syncs[i]);
+  }
+
+  for (int tick = 0; tick < CORPUS_TICKS; tick++) {
+    for (int i = 0; i < 2; i++) {
+      GameState& state = states[i];
+      const Inputs local = {{0, followBall(state, DOWN_PADDLE, rng, 8)}};
+      Inputs inputs = local;
+      int remotePoint = 0;
+      if (hasTick[i]) {
+        recorders[i]->remote(inbox[i], 0);
+        SyncResult synced = syncs[i].apply(state, inbox[i]);
+        inputs.moves[UP_PADDLE] = synced.remoteMove;
+        remotePoint = synced.scored;
+        hasTick[i] = false;
+      }
+      int scored = step(state, inputs);
+      recorders[i]->tick(local, state, syncs[i]);
+      // Every few ticks get lost on the way
+      if (rng % 16) {
+        inbox[1 - i] = syncs[i].makeTick(state, scored);
+        hasTick[1 - i] = true;
+      }
+      int point = syncs[i].getIsHost() ? scored : remotePoint;
+      if (point) {
+        recorders[i]->point(point);
+        syncs[i].scorePoint(state, point);
+      }
+    }
+  }
+
+  for (ReplayRecorder* recorder : recorders) {
+    corpus.emplace_back();
+    recorder->flush(appendRecording, &corpus.back());
+    delete recorder;
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testCorpusReplays() {
+  std::vector<Recording> corpus;
+  for (int i = 0; i < CORPUS_MATCHES; i++) recordMatch(i, corpus);
+
+  int failed = 0;
+  // Recorders are the only thing tagged, and every one was deleted
+  int32_t leaked = heapUsage(HEAP_REPLAY).liveBlocks;
+  uint32_t allocationsBefore = heapAllocations();
+  for (const Recording& recording : corpus) {
+    ReplayResult result = runReplay(recording.data(), recording.size());
+    if (result.valid && result.mismatches == 0) continue;
+    failed++;
+    printf("%s, %u ticks, %u/%u hashes mismatched, first at tick %u\n", result.valid ? "valid" : "invalid",
+           result.ticks, result.mismatches, result.hashesChecked, result.firstMismatch);
+  }
+
+  size_t bytes = 0;
+  uint64_t ticks = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+    for (const Recording& recording : corpus) {
+      ticks += runReplay(recording.data(), recording.size()).ticks;
+      bytes += recording.size();
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint32_t allocations = heapAllocations() - allocationsBefore;
+
+  printf("%zu recordings, %.1f bytes per tick\n", corpus.size(), (double) bytes / ticks);
+  printf("Replayed %llu ticks in %.3f s, %.1f M ticks/s\n", (unsigned long long) ticks, elapsed, ticks / elapsed / 1e6);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, failed, "Recordings didn't replay");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, leaked, "Recorder blocks leaked");
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, allocations, "Replaying allocated");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testCorpusReplays);
+  return UNITY_END();
+}
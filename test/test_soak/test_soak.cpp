@@ -0,0 +1,317 @@
+// Soak test for multiplayer. Runs many host/joiner pairs across a thread
+// pool, each pair driving the same simulation and TickSync the firmware uses
+// over an emulated ESP-NOW link, and fails on score desyncs, a ball drifting
+// apart in play, or matches that allocate or leak. Per-tick latency is
+// printed along the way.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unity.h>
+#include <vector>
+#include "heap_tracker.h"
+#include "helpers.h"
+#include "simulation.h"
+#include "sync.h"
+
+// Timing of the firmware loop and scenes, see main.cpp and game.h
+#define SOAK_INTERVAL_MS 33
+#define SOAK_POINT_PAUSE_MS 1100
+
+#define SOAK_PAIRS 256
+#define SOAK_SECONDS 600
+#define MAX_IN_FLIGHT 32
+// While the ball is in play. A paddle the boards see at different places can
+// bounce the ball on one and not the other, until the next host tick
+#define SOAK_MAX_DIVERGENCE fromFixed(2 * Board::ballMaxSpeed)
+#define LATENCY_BUCKET_NS 16
+#define LATENCY_BUCKETS 4096
+
+typedef struct LinkProfile {
+  uint32_t latencyMs;
+  uint32_t jitterMs;
+  // Out of 1000 packets
+  uint32_t lossPerMille;
+} LinkProfile;
+
+typedef struct Packet {
+  uint32_t arrival;
+  RemoteTick tick;
+} Packet;
+
+// One direction of an ESP-NOW link. Packets arrive after a random delay, so
+// they can be reordered or lost, and like Network::poll() each arrival
+// replaces the one waiting to be read.
+class EmulatedLink {
+public:
+  EmulatedLink(): profile{0, 0, 0}, rng(1), inFlight(0), hasTick(false), lost(0) {}
+
+  void init(const LinkProfile& profile, uint32_t seed) {
+    this->profile = profile;
+    rng = seed | 1;
+  }
+
+  void send(uint32_t now, const RemoteTick& tick) {
+    deliver(now);
+    if (xorshift(rng) % 1000 < profile.lossPerMille || inFlight == MAX_IN_FLIGHT) {
+      lost++;
+      return;
+    }
+    uint32_t jitter = profile.jitterMs ? xorshift(rng) % (profile.jitterMs + 1) : 0;
+    packets[inFlight++] = {now + profile.latencyMs + jitter, tick};
+  }
+
+  bool receive(uint32_t now, RemoteTick& tick) {
+    deliver(now);
+    if (!hasTick) return false;
+    hasTick = false;
+    tick = latest;
+    return true;
+  }
+
+  uint32_t getLost() {
+    return lost;
+  }
+private:
+  LinkProfile profile;
+  uint32_t rng;
+  Packet packets[MAX_IN_FLIGHT];
+  int inFlight;
+  RemoteTick latest;
+  bool hasTick;
+  uint32_t lost;
+
+  // Everything that arrived by now, in arrival order, so the last one to
+  // arrive is what gets read
+  void deliver(uint32_t now) {
+    while (true) {
+      int next = -1;
+      for (int i = 0; i < inFlight; i++) {
+        if (packets[i].arrival > now) continue;
+        if (next < 0 || packets[i].arrival < packets[next].arrival) next = i;
+      }
+      if (next < 0) return;
+      latest = packets[next].tick;
+      hasTick = true;
+      packets[next] = packets[--inFlight];
+    }
+  }
+};
+
+typedef struct LatencyStats {
+  uint64_t buckets[LATENCY_BUCKETS + 1];
+  uint64_t count;
+  uint64_t maxNs;
+} LatencyStats;
+
+typedef struct PairReport {
+  uint64_t ticks;
+  uint64_t corrections;
+  uint64_t lostPackets;
+  // Ticks in play where the joiner's mirrored ball is more than a pixel off
+  // the host's. Once out, each board stops it where it noticed.
+  uint64_t divergedTicks;
+  int32_t maxDivergence;
+  bool scoresDesynced;
+} PairReport;
+
+// One board's side of Game::tick(), without the display, buttons or radio
+typedef struct EmulatedBoard {
+  GameState state;
+  TickSync sync;
+  uint32_t nextFrame;
+  uint32_t pausedUntil;
+  int scoredPlayer;
+  uint32_t rng;
+} EmulatedBoard;
+
+static void recordLatency(LatencyStats& stats, uint64_t ns) {
+  stats.buckets[std::min<uint64_t>(ns / LATENCY_BUCKET_NS, LATENCY_BUCKETS)]++;
+  stats.count++;
+  stats.maxNs = std::max(stats.maxNs, ns);
+}
+
+static uint64_t percentile(const LatencyStats& stats, double fraction) {
+  uint64_t target = (uint64_t) (stats.count * fraction);
+  uint64_t seen = 0;
+  for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+    seen += stats.buckets[i];
+    if (seen > target) return (uint64_t) i * LATENCY_BUCKET_NS;
+  }
+  return stats.maxNs;
+}
+
+static bool inPlay(const BallState& ball) {
+  int y = fromFixed(ball.y);
+  return y >= 0 && y <= Board::height;
+}
+
+// Returns true when the board stepped, so its state is at a new tick
+static bool frame(EmulatedBoard& board, EmulatedLink& inbox, EmulatedLink& outbox, uint32_t now,
+                  LatencyStats& latency, PairReport& report) {
+  if (now < board.pausedUntil) return false;
+  if (board.scoredPlayer) {
+    board.sync.scorePoint(board.state, board.scoredPlayer);
+    board.scoredPlayer = 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  // A player that follows the ball, but not always in time
+  Inputs inputs = {{0, followBall(board.state, DOWN_PADDLE, board.rng, 8)}};
+  RemoteTick remote;
+  int remotePoint = 0;
+  if (inbox.receive(now, remote)) {
+    SyncResult result = board.sync.apply(board.state, remote);
+    inputs.moves[UP_PADDLE] = result.remoteMove;
+    report.corrections += result.corrections;
+    remotePoint = result.scored;
+  }
+  int scored = step(board.state, inputs);
+  outbox.send(now, board.sync.makeTick(board.state, scored));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  recordLatency(latency, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+  // Like Game::tick(), the joiner scores what the host scored
+  if (!board.sync.getIsHost()) scored = remotePoint;
+  if (scored) {
+    board.scoredPlayer = scored;
+    board.pausedUntil = now + SOAK_POINT_PAUSE_MS;
+  }
+  report.ticks++;
+  return true;
+}
+
+static void runPair(int index, uint32_t durationMs, LatencyStats& latency, PairReport& report) {
+  uint32_t rng = 0x9E3779B9u * (index + 1);
+  EmulatedBoard boards[2];
+  EmulatedLink links[2];
+  // Sent by the host with its accept
+  uint32_t seed = xorshift(rng);
+  for (int i = 0; i < 2; i++) {
+    EmulatedBoard& board = boards[i];
+    initState(board.state, seed);
+    board.sync.reset(i == 0);
+    board.sync.resetMatch(board.state);
+    // The joiner starts once the accept reaches it
+    board.nextFrame = i == 0 ? 0 : 1 + xorshift(rng) % 200;
+    board.pausedUntil = 0;
+    board.scoredPlayer = 0;
+    board.rng = xorshift(rng) | 1;
+
+    LinkProfile profile = {1 + xorshift(rng) % 5, xorshift(rng) % 40, xorshift(rng) % 100};
+    links[i].init(profile, xorshift(rng));
+  }
+  EmulatedBoard& host = boards[0];
+  EmulatedBoard& joiner = boards[1];
+
+  // The host's ball by tick, to compare against the joiner's at the same tick
+  BallState hostBalls[64];
+  uint32_t hostTicks[64] = {0};
+
+  while (host.nextFrame < durationMs || joiner.nextFrame < durationMs) {
+    bool hostNext = host.nextFrame <= joiner.nextFrame;
+    EmulatedBoard& board = hostNext ? host : joiner;
+    uint32_t now = board.nextFrame;
+    // links[0] carries the host's ticks to the joiner
+    bool stepped = hostNext ? frame(host, links[1], links[0], now, latency, report)
+                            : frame(joiner, links[0], links[1], now, latency, report);
+    // The loop can run a little late when a frame takes longer to draw
+    board.nextFrame += SOAK_INTERVAL_MS + (xorshift(board.rng) % 16 == 0 ? 1 + xorshift(board.rng) % 4 : 0);
+    if (!stepped) continue;
+
+    uint32_t tick = board.state.tick;
+    if (hostNext) {
+      hostBalls[tick % 64] = host.state.ball;
+      hostTicks[tick % 64] = tick;
+    } else if (hostTicks[tick % 64] == tick && inPlay(hostBalls[tick % 64]) && inPlay(joiner.state.ball)) {
+      const BallState& ball = hostBalls[tick % 64];
+      int32_t dx = abs(toFixed(WINDOW_WIDTH) - ball.x - joiner.state.ball.x);
+      int32_t dy = abs(toFixed(WINDOW_HEIGHT) - ball.y - joiner.state.ball.y);
+      int32_t divergence = fromFixed(std::max(dx, dy));
+      report.maxDivergence = std::max(report.maxDivergence, divergence);
+      if (divergence > 1) report.divergedTicks++;
+    }
+  }
+  // Points still pending at the end count, as the scene would award them
+  for (EmulatedBoard& board : boards) {
+    if (board.scoredPlayer) board.sync.scorePoint(board.state, board.scoredPlayer);
+  }
+  report.scoresDesynced = host.state.scores[UP_PADDLE] != joiner.state.scores[DOWN_PADDLE] ||
+                          host.state.scores[DOWN_PADDLE] != joiner.state.scores[UP_PADDLE];
+  report.lostPackets = links[0].getLost() + links[1].getLost();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testPairsStayInSync() {
+  const int pairs = SOAK_PAIRS;
+  const uint32_t seconds = SOAK_SECONDS;
+  const int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<PairReport> reports(pairs, PairReport{0, 0, 0, 0, 0, false});
+  std::vector<LatencyStats> latencies(threads, LatencyStats{{0}, 0, 0});
+  std::atomic<int> nextPair(0);
+  std::vector<std::thread> pool;
+  pool.reserve(threads);
+  int64_t liveBefore = heapLiveBlocks();
+  int64_t totalBefore = heapAllocations();
+
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back([&, t]() {
+      for (int pair = nextPair++; pair < pairs; pair = nextPair++) {
+        runPair(pair, seconds * 1000, latencies[t], reports[pair]);
+      }
+    });
+  }
+  for (std::thread& thread : pool) thread.join();
+  pool.clear();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  int64_t leaked = heapLiveBlocks() - liveBefore;
+  // Starting each thread allocates once, matches themselves never should
+  int64_t allocations = heapAllocations() - totalBefore - threads;
+
+  LatencyStats latency = {{0}, 0, 0};
+  for (const LatencyStats& stats : latencies) {
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) latency.buckets[i] += stats.buckets[i];
+    latency.count += stats.count;
+    latency.maxNs = std::max(latency.maxNs, stats.maxNs);
+  }
+  PairReport total = {0, 0, 0, 0, 0, false};
+  int desynced = 0, diverged = 0;
+  for (const PairReport& report : reports) {
+    total.ticks += report.ticks;
+    total.corrections += report.corrections;
+    total.lostPackets += report.lostPackets;
+    total.divergedTicks += report.divergedTicks;
+    total.maxDivergence = std::max(total.maxDivergence, report.maxDivergence);
+    desynced += report.scoresDesynced;
+    diverged += report.divergedTicks > 0;
+  }
+
+  printf("%d pairs x %u s of play on %d threads in %.2f s\n", pairs, seconds, threads, elapsed);
+  printf("Ticks: %llu, lost packets: %llu, ball corrections: %llu\n",
+         (unsigned long long) total.ticks, (unsigned long long) total.lostPackets,
+         (unsigned long long) total.corrections);
+  printf("Score desyncs: %d pairs\n", desynced);
+  printf("Ball divergence in play: %d pairs, %llu ticks over 1 px, max %d px (%d allowed)\n",
+         diverged, (unsigned long long) total.divergedTicks, total.maxDivergence, SOAK_MAX_DIVERGENCE);
+  printf("Allocations during matches: %lld, leaked: %lld\n", (long long) allocations, (long long) leaked);
+  printf("Tick latency: p50 %llu ns, p99 %llu ns, max %llu ns\n",
+         (unsigned long long) percentile(latency, 0.5), (unsigned long long) percentile(latency, 0.99),
+         (unsigned long long) latency.maxNs);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, desynced, "Pairs ended with different scores");
+  TEST_ASSERT_LESS_OR_EQUAL_INT_MESSAGE(SOAK_MAX_DIVERGENCE, total.maxDivergence, "Ball diverged in play");
+  TEST_ASSERT_LESS_OR_EQUAL_INT64_MESSAGE(0, allocations, "Matches allocated");
+  TEST_ASSERT_LESS_OR_EQUAL_INT64_MESSAGE(0, leaked, "Matches leaked");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testPairsStayInSync);
+  return UNITY_END();
+}
@@ -0,0 +1,128 @@
+// Properties of the swept collision in step(), over random balls, paddles and
+// speeds up to the fastest rally, started next to a paddle face or a side
+// wall. The ball never ends a tick outside the side walls, and a ball whose
+// path crosses a paddle is always sent back, however fast it goes. Where the
+// path would cross is worked out in floating point, independent of the
+// fixed point sweep, and paths grazing a paddle corner are left out.
+#include <cmath>
+#include <cstdio>
+#include <unity.h>
+#include "helpers.h"
+#include "simulation.h"
+
+#define SWEEP_TRIALS 200000
+// Paths closer than this to a paddle corner, in pixels, could go either way
+#define GRAZE_MARGIN 1.0
+
+static int32_t randomBetween(uint32_t& rng, int32_t min, int32_t max) {
+  return min + (int32_t) (xorshift(rng) % (uint32_t) (max - min + 1));
+}
+
+static double toPixels(fixed_t value) {
+  return (double) value / FIXED_ONE;
+}
+
+// Where the center of the ball is after moving by distance from x, folded
+// back into the field at the side walls
+static double foldX(double x, double distance) {
+  double half = toPixels(Board::ballHalfSize);
+  double low = half, span = Board::width - 2 * half;
+  double folded = std::fmod(x + distance - low, 2 * span);
+  if (folded < 0) folded += 2 * span;
+  return low + (folded > span ? 2 * span - folded : folded);
+}
+
+// A ball heading for the paddle in slot, its leading edge up to a tick and a
+// bit away from the face, sometimes right at a side wall, and a paddle
+// anywhere it can be
+static GameState randomState(uint32_t& rng, PaddleSlot slot) {
+  GameState state;
+  initState(state, 1);
+  for (int i = 0; i < PADDLE_COUNT; i++) setPaddlePos(state, (PaddleSlot) i, randomBetween(rng, 0, Board::width));
+
+  BallState& ball = state.ball;
+  fixed_t half = Board::ballHalfSize;
+  switch (xorshift(rng) % 4) {
+    case 0: ball.x = half; break;
+    case 1: ball.x = toFixed(Board::width) - half; break;
+    default: ball.x = randomBetween(rng, half, toFixed(Board::width) - half); break;
+  }
+  ball.xSpeed = randomBetween(rng, -Board::ballMaxXSpeed, Board::ballMaxXSpeed);
+  fixed_t ySpeed = randomBetween(rng, 1, Board::ballMaxSpeed);
+  fixed_t distance = randomBetween(rng, 0, ySpeed + ySpeed / 4);
+  Rect bounds = paddleBounds(slot, state.paddles[slot]);
+  if (slot == DOWN_PADDLE) {
+    ball.y = toFixed(bounds.y) - distance - half;
+    ball.ySpeed = ySpeed;
+  } else {
+    ball.y = toFixed(bounds.y + bounds.h) + distance + half;
+    ball.ySpeed = -ySpeed;
+  }
+  return state;
+}
+
+static void sweepFace(PaddleSlot slot, uint32_t seed) {
+  uint32_t rng = seed;
+  int hits = 0, misses = 0, escapes = 0, tunnelled = 0, phantoms = 0;
+  double half = toPixels(Board::ballHalfSize);
+  for (int trial = 0; trial < SWEEP_TRIALS; trial++) {
+    GameState state = randomState(rng, slot);
+    const BallState start = state.ball;
+    Rect bounds = paddleBounds(slot, state.paddles[slot]);
+    Inputs inputs = {};
+    step(state, inputs);
+    const BallState& ball = state.ball;
+
+    if (ball.x - Board::ballHalfSize < 0 || ball.x + Board::ballHalfSize > toFixed(Board::width)) escapes++;
+
+    // When the leading edge of the ball reaches the face, if within the tick
+    double face = slot == DOWN_PADDLE ? bounds.y : bounds.y + bounds.h;
+    double distance = std::fabs(face - (toPixels(start.y) + (slot == DOWN_PADDLE ? half : -half)));
+    double time = distance / std::fabs(toPixels(start.ySpeed));
+    if (time > 1) continue;
+    double x = foldX(toPixels(start.x), toPixels(start.xSpeed) * time);
+    // How far inside the paddle the ball is, negative when it passes beside it
+    double overlap = std::fmin(x + half - bounds.x, bounds.x + bounds.w - (x - half));
+    if (std::fabs(overlap) < GRAZE_MARGIN) continue;
+
+    bool bounced = (ball.ySpeed > 0) != (start.ySpeed > 0);
+    if (overlap > 0) {
+      hits++;
+      // A ball reaching the face right as the tick ends can stop just short
+      // of it and bounce on the next one, but never ends up past it
+      fixed_t edge = slot == DOWN_PADDLE ? ball.y + Board::ballHalfSize : ball.y - Board::ballHalfSize;
+      bool inField = slot == DOWN_PADDLE ? edge <= toFixed(bounds.y) : edge >= toFixed(bounds.y + bounds.h);
+      if (!inField) tunnelled++;
+    } else {
+      misses++;
+      if (bounced) phantoms++;
+    }
+  }
+  printf("%s paddle: %d hits, %d misses, %d tunnelled, %d bounced off nothing, %d out of the walls\n",
+         slot == DOWN_PADDLE ? "Down" : "Up", hits, misses, tunnelled, phantoms, escapes);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, escapes, "The ball ended a tick outside the side walls");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, tunnelled, "The ball went through a paddle");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, phantoms, "The ball bounced off a paddle it missed");
+  // Both outcomes have to come up for the properties to mean anything
+  TEST_ASSERT_GREATER_THAN_INT_MESSAGE(SWEEP_TRIALS / 20, hits, "Too few paths crossed the paddle");
+  TEST_ASSERT_GREATER_THAN_INT_MESSAGE(SWEEP_TRIALS / 20, misses, "Too few paths passed beside the paddle");
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void testDownPaddleFace() {
+  sweepFace(DOWN_PADDLE, 12345);
+}
+
+static void testUpPaddleFace() {
+  sweepFace(UP_PADDLE, 67890);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testDownPaddleFace);
+  RUN_TEST(testUpPaddleFace);
+  return UNITY_END();
+}